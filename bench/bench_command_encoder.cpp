@@ -0,0 +1,70 @@
+/*|Command Encoder Benchmark|--------------------------------------------------
+#
+# Throughput of CCommandEncoder::RotateJoint against the sprintf path it
+# replaces in main.cpp, plus a byte-for-byte comparison of their output.
+#
+# Usage: bench_command_encoder [commands]
+# -----------------------------------------------------------------------------*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "command_encoder.h"
+
+using namespace openutils;
+
+#define MAX_STRING 256
+
+int main(int argc, char** argv) {
+   long count = argc > 1 ? atol(argv[1]) : 2000000;
+   std::vector<double> ang1(count), ang2(count);
+   std::mt19937_64 rng(1270);
+   std::uniform_real_distribution<double> j1(-150.0, 150.0), j2(-170.0, 170.0);
+   for (long i = 0; i < count; i++) {
+      ang1[i] = j1(rng);
+      ang2[i] = j2(rng);
+   }
+
+   char commandString[MAX_STRING];
+   size_t checksum = 0;
+
+   auto start = std::chrono::steady_clock::now();
+   for (long i = 0; i < count; i++) {
+      checksum += sprintf(&commandString[0], "ROTATE_JOINT ANG1 %.2lf ANG2 %.2lf\n", ang1[i], ang2[i]);
+   }
+   double sprintfSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   CCommandEncoder encoder(commandString, MAX_STRING);
+   start = std::chrono::steady_clock::now();
+   for (long i = 0; i < count; i++) {
+      encoder.Reset();
+      encoder.RotateJoint(ang1[i], ang2[i]);
+      checksum += encoder.GetLength();
+   }
+   double encoderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   // Output must match sprintf exactly, including ties and negative zero
+   long mismatches = 0;
+   char expected[MAX_STRING];
+   double edge[] = { 0.125, -0.125, 0.005, -0.001, -0.0, 149.995, -169.995, 2.675, 1.005 };
+   long edgeCount = (long)(sizeof(edge) / sizeof(edge[0]));
+   for (long i = 0; i < count + edgeCount; i++) {
+      double a = i < count ? ang1[i] : edge[i - count];
+      double b = i < count ? ang2[i] : -edge[i - count];
+      int len = sprintf(expected, "ROTATE_JOINT ANG1 %.2lf ANG2 %.2lf\n", a, b);
+      encoder.Reset();
+      encoder.RotateJoint(a, b);
+      if (encoder.GetLength() != len || memcmp(expected, encoder.GetData(), len) != 0) {
+         if (mismatches++ < 5) printf("mismatch: %.*s vs %s", encoder.GetLength(), encoder.GetData(), expected);
+      }
+   }
+
+   printf("commands: %ld (checksum %zu)\n", count, checksum);
+   printf("%-18s %10.3f s %10.2f Mcmd/s\n", "sprintf", sprintfSeconds, count / sprintfSeconds / 1e6);
+   printf("%-18s %10.3f s %10.2f Mcmd/s\n", "CCommandEncoder", encoderSeconds, count / encoderSeconds / 1e6);
+   printf("speedup: %.2fx, mismatches: %ld\n", sprintfSeconds / encoderSeconds, mismatches);
+   return mismatches == 0 ? 0 : 1;
+}
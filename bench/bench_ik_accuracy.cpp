@@ -0,0 +1,197 @@
+/*|Inverse Kinematics Accuracy Benchmark|--------------------------------------
+#
+# Times scaraIK() and scaraIKBatch() for both arm solutions, and scaraFK()
+# and scaraFKBatch() on their results, over three point distributions:
+#
+#   uniform    uniform over the annulus MIN_REACH..MAX_REACH
+#   boundary   within 1 mm of MIN_REACH or MAX_REACH, half of them within 1 um
+#   outside    inside MIN_REACH or beyond MAX_REACH, all rejected
+#
+# It reports ns/point, the largest IK->FK round-trip position error against
+# the input, and scalar/batch disagreements in status and joint angles. A
+# table by radius then shows where the solvers lose precision: the elbow
+# angle comes from acos(c) (the batch solver from atan2(sqrt(1-c*c), c)),
+# whose slope d(theta2)/dr grows without bound as the arm straightens, so
+# the last band before MAX_REACH loses digits. Folded, the same happens at
+# L1-L2, but the 170 degree elbow limit stops IK at MIN_REACH, 12.5 mm
+# short of it; points in between are rejected with -2.
+#
+# Usage: bench_ik_accuracy [points per distribution]
+# Fails on a status disagreement or a round trip off by more than 1 um.
+# -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "scara_kinematics.h"
+
+#define ROUND_TRIP_LIMIT 1e-3 /// mm, about a hundredth of what 0.01 degree moves the tool
+
+typedef std::chrono::steady_clock Clock;
+
+static const double MIN_REACH = Lab07Arm::MIN_REACH;
+static const double MAX_REACH = Lab07Arm::MAX_REACH;
+static const double FOLDED = Lab07Arm::LINK1 - Lab07Arm::LINK2;
+
+struct Band {
+   const char* name;
+   double to; // upper radius in mm
+   long points, solved, mismatches;
+   double maxError, maxAngleDiff, maxSlope;
+};
+
+static const char* BAND_NAMES[] = {
+   "folded (< L1-L2)",
+   "L1-L2 .. MIN_REACH",
+   "MIN_REACH + 1 mm",
+   "MIN_REACH + 10 mm",
+   "interior",
+   "MAX_REACH - 10 mm",
+   "MAX_REACH - 1 mm",
+   "MAX_REACH - 1 um",
+   "beyond MAX_REACH",
+};
+static const int BAND_COUNT = (int)(sizeof(BAND_NAMES) / sizeof(BAND_NAMES[0]));
+static Band BANDS[BAND_COUNT];
+
+static void initBands() {
+   const double edges[] = { 0.0, FOLDED, MIN_REACH, MIN_REACH + 1.0, MIN_REACH + 10.0, MAX_REACH - 10.0,
+                            MAX_REACH - 1.0, MAX_REACH - 1e-3, MAX_REACH, 1e9 };
+   static_assert(sizeof(edges) / sizeof(edges[0]) == BAND_COUNT + 1, "one upper edge per band");
+   for (int b = 0; b < BAND_COUNT; b++) {
+      BANDS[b] = Band();
+      BANDS[b].name = BAND_NAMES[b];
+      BANDS[b].to = edges[b + 1];
+   }
+}
+
+static Band* bandOf(double r) {
+   for (int b = 0; b < BAND_COUNT - 1; b++)
+      if (r < BANDS[b].to) return &BANDS[b];
+   return &BANDS[BAND_COUNT - 1];
+}
+
+// Degrees of elbow rotation per mm of radius: theta2 = acos((r^2 - L1^2 - L2^2) / (2 L1 L2))
+static double elbowSlope(double r) {
+   double c = (r * r - Lab07Arm::LINK1_SQ - Lab07Arm::LINK2_SQ) / Lab07Arm::TWO_LINK1_LINK2;
+   double s = sqrt(fmax(0.0, 1.0 - c * c));
+   return s == 0.0 ? HUGE_VAL : 2.0 * r / (Lab07Arm::TWO_LINK1_LINK2 * s) * 180.0 / SCARA_PI;
+}
+
+static void generate(const char* distribution, size_t n, std::vector<double>* x, std::vector<double>* y) {
+   std::mt19937_64 rng(1270);
+   std::uniform_real_distribution<double> unit(0.0, 1.0), angle(-SCARA_PI, SCARA_PI);
+   x->resize(n);
+   y->resize(n);
+   for (size_t i = 0; i < n; i++) {
+      double r, u = unit(rng);
+      if (distribution[0] == 'u') {
+         // Uniform by area
+         r = sqrt(MIN_REACH * MIN_REACH + u * (MAX_REACH * MAX_REACH - MIN_REACH * MIN_REACH));
+      } else if (distribution[0] == 'b') {
+         double depth = (i & 2) ? u * 1e-3 : u;
+         r = (i & 1) ? MAX_REACH - depth : MIN_REACH + depth;
+      } else {
+         r = (i & 1) ? MAX_REACH + 1e-9 + u * 200.0 : u * MIN_REACH * (1.0 - 1e-12);
+      }
+      double a = angle(rng);
+      (*x)[i] = r * cos(a);
+      (*y)[i] = r * sin(a);
+   }
+}
+
+template <class F> static double nsPerPoint(size_t n, F f) {
+   Clock::time_point start = Clock::now();
+   f();
+   return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n;
+}
+
+int main(int argc, char** argv) {
+   size_t n = argc > 1 ? (size_t)atol(argv[1]) : 1000000;
+   const char* distributions[] = { "uniform", "boundary", "outside" };
+   std::vector<double> x, y, j1(n), j2(n), bj1(n), bj2(n), fx(n), fy(n);
+   std::vector<int> code(n);
+   std::vector<signed char> error(n);
+   std::vector<unsigned char> status(n);
+   initBands();
+
+   printf("%zu points per distribution, backend: %s\n", n, scaraSimdBackend());
+   printf("L1-L2 %.3f mm, MIN_REACH %.3f mm (elbow at %.0f deg), MAX_REACH %.3f mm\n\n",
+          FOLDED, MIN_REACH, Lab07Arm::MAX_THETA2_DEG, MAX_REACH);
+   printf("%-9s %-6s %9s %9s %9s %9s %9s %12s %12s %10s\n", "points", "arm", "solved", "IK ns", "IKBatch",
+          "FK ns", "FKBatch", "max err mm", "batch err", "mismatch");
+
+   long failures = 0;
+   double worst = 0.0;
+   for (int d = 0; d < 3; d++) {
+      generate(distributions[d], n, &x, &y);
+      for (int arm = LEFT_ARM_SOLUTION; arm <= RIGHT_ARM_SOLUTION; arm++) {
+         size_t solved = 0;
+         double ik = nsPerPoint(n, [&] {
+            for (size_t i = 0; i < n; i++) {
+               code[i] = scaraIK(x[i], y[i], &j1[i], &j2[i], arm);
+               solved += code[i] == 0;
+            }
+         });
+         double ikBatch = nsPerPoint(n, [&] {
+            scaraIKBatch(x.data(), y.data(), bj1.data(), bj2.data(), error.data(), n, arm);
+         });
+         // Rejected points keep the last solution so FK times valid angles throughout
+         for (size_t i = 1; i < n; i++)
+            if (code[i] != 0) { j1[i] = j1[i - 1]; j2[i] = j2[i - 1]; }
+         double fk = NAN, fkBatch = NAN;
+         if (solved > 0) {
+            fk = nsPerPoint(n, [&] {
+               for (size_t i = 0; i < n; i++) scaraFK(j1[i], j2[i], &fx[i], &fy[i]);
+            });
+            fkBatch = nsPerPoint(n, [&] {
+               scaraFKBatch(bj1.data(), bj2.data(), fx.data(), fy.data(), status.data(), n);
+            });
+         }
+
+         double maxError = 0.0, maxBatchError = 0.0;
+         long mismatches = 0;
+         for (size_t i = 0; i < n; i++) {
+            Band* band = bandOf(hypot(x[i], y[i]));
+            band->points++;
+            if (code[i] != error[i]) {
+               band->mismatches++;
+               mismatches++;
+               continue;
+            }
+            if (code[i] != 0) continue;
+            band->solved++;
+            double sx, sy;
+            scaraFK(j1[i], j2[i], &sx, &sy);
+            double e = hypot(sx - x[i], sy - y[i]);
+            double be = status[i] == 0 ? hypot(fx[i] - x[i], fy[i] - y[i]) : HUGE_VAL;
+            maxError = fmax(maxError, e);
+            maxBatchError = fmax(maxBatchError, be);
+            band->maxError = fmax(band->maxError, fmax(e, be));
+            band->maxAngleDiff = fmax(band->maxAngleDiff, fmax(fabs(j1[i] - bj1[i]), fabs(j2[i] - bj2[i])));
+            band->maxSlope = fmax(band->maxSlope, elbowSlope(hypot(x[i], y[i])));
+         }
+         failures += mismatches;
+         worst = fmax(worst, fmax(maxError, maxBatchError));
+         printf("%-9s %-6s %9zu %9.1f %9.1f %9.1f %9.1f %12.3g %12.3g %10ld\n", distributions[d],
+                arm == RIGHT_ARM_SOLUTION ? "right" : "left", solved, ik, ikBatch, fk, fkBatch, maxError,
+                maxBatchError, mismatches);
+      }
+   }
+
+   printf("\n%-20s %10s %10s %12s %12s %14s %9s\n", "radius band", "points", "solved", "max err mm",
+          "max dj deg", "deg/mm elbow", "mismatch");
+   for (int b = 0; b < BAND_COUNT; b++) {
+      const Band& band = BANDS[b];
+      const char* note = "";
+      if (b == 1) note = "  rejected: elbow past its limit";
+      else if (band.solved > 0 && band.maxSlope > 10.0) note = "  ill-conditioned: acos near +/-1";
+      printf("%-20s %10ld %10ld %12.3g %12.3g %14.3g %9ld%s\n", band.name, band.points, band.solved,
+             band.maxError, band.maxAngleDiff, band.maxSlope, band.mismatches, note);
+   }
+   printf("\nworst round trip %.3g mm (limit %.0g), %ld status mismatches\n", worst, ROUND_TRIP_LIMIT, failures);
+   return failures == 0 && worst <= ROUND_TRIP_LIMIT ? 0 : 1;
+}
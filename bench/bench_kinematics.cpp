@@ -0,0 +1,64 @@
+/*|Kinematics Benchmark|-------------------------------------------------------
+#
+# Forward kinematics throughput in points per second: scalar scaraFK() over
+# every sample against scaraFKBatch(), plus the largest position difference
+# and status disagreement between the two.
+#
+# Usage: bench_kinematics [samples]
+# -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "scara_kinematics.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds(Clock::time_point start) {
+   return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+   size_t n = argc > 1 ? (size_t)atol(argv[1]) : 1000000;
+   std::vector<double> j1(n), j2(n), x(n), y(n), bx(n), by(n);
+   std::vector<int> code(n);
+   std::vector<unsigned char> status(n);
+
+   // Slightly wider than the joint limits so some samples are rejected
+   std::mt19937_64 rng(1270);
+   std::uniform_real_distribution<double> d1(-160.0, 160.0), d2(-180.0, 180.0);
+   for (size_t i = 0; i < n; i++) {
+      j1[i] = d1(rng);
+      j2[i] = d2(rng);
+   }
+
+   Clock::time_point start = Clock::now();
+   size_t scalarValid = 0;
+   for (size_t i = 0; i < n; i++) {
+      code[i] = scaraFK(j1[i], j2[i], &x[i], &y[i]);
+      scalarValid += code[i] == 0;
+   }
+   double scalarSeconds = seconds(start);
+
+   start = Clock::now();
+   size_t batchValid = scaraFKBatch(j1.data(), j2.data(), bx.data(), by.data(), status.data(), n);
+   double batchSeconds = seconds(start);
+
+   double maxDiff = 0.0;
+   size_t statusMismatches = 0;
+   for (size_t i = 0; i < n; i++) {
+      int expected = code[i] == 0 ? 0 : 1;
+      if ((status[i] != 0) != expected) statusMismatches++;
+      if (code[i] == 0) maxDiff = fmax(maxDiff, fmax(fabs(x[i] - bx[i]), fabs(y[i] - by[i])));
+   }
+
+   printf("samples: %zu, in range: %zu scalar / %zu batch, backend: %s\n", n, scalarValid, batchValid, scaraSimdBackend());
+   printf("%-14s %10.2f Mpoints/s\n", "scaraFK", n / scalarSeconds / 1e6);
+   printf("%-14s %10.2f Mpoints/s\n", "scaraFKBatch", n / batchSeconds / 1e6);
+   printf("speedup: %.2fx, max |dx|,|dy|: %.3g mm, status mismatches: %zu\n",
+          scalarSeconds / batchSeconds, maxDiff, statusMismatches);
+   return statusMismatches == 0 && maxDiff < 1e-6 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+/*|SPSC Ring Benchmark|--------------------------------------------------------
+#
+# Compares CSpscRing against a std::mutex + std::deque queue for handing
+# pre-encoded ROTATE_JOINT records from a planner thread to a writer thread.
+# The writer drains in batches and gathers each batch into one contiguous
+# send buffer, as a socket writer would before a single send().
+#
+# Usage: bench_spsc_ring [records]
+# -----------------------------------------------------------------------------*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "command_record.h"
+#include "spsc_ring.h"
+
+using namespace openutils;
+
+#define RING_CAPACITY   4096
+#define DRAIN_BATCH     64
+
+static CCommandRecord makeRecord(long i)
+{
+   char text[MAX_COMMAND_LENGTH];
+   int len = snprintf(text, sizeof(text), "ROTATE_JOINT ANG1 %.2f ANG2 %.2f\n", (i % 300) - 150.0, (i % 340) - 170.0);
+   CCommandRecord record;
+   record.Set(text, len);
+   return record;
+}
+
+// Gathers a drained batch into the writer's send buffer. Returns bytes gathered.
+static size_t gather(const CCommandRecord* records, size_t n, char* sendBuffer) {
+   size_t bytes = 0;
+   for (size_t i = 0; i < n; i++) {
+      memcpy(sendBuffer + bytes, records[i].data, records[i].length);
+      bytes += records[i].length;
+   }
+   return bytes;
+}
+
+static double benchRing(long count, const CCommandRecord& sample, size_t* bytesOut) {
+   static CSpscRing<CCommandRecord, RING_CAPACITY> ring;
+   auto start = std::chrono::steady_clock::now();
+
+   std::thread producer([&]() {
+      for (long i = 0; i < count; i++) {
+         while (!ring.TryPush(sample)) std::this_thread::yield();
+      }
+   });
+
+   CCommandRecord drained[DRAIN_BATCH];
+   char sendBuffer[DRAIN_BATCH * COMMAND_RECORD_SIZE];
+   size_t bytes = 0;
+   long received = 0;
+   while (received < count) {
+      size_t n = ring.PopBatch(drained, DRAIN_BATCH);
+      if (n == 0) { std::this_thread::yield(); continue; }
+      bytes += gather(drained, n, sendBuffer);
+      received += (long)n;
+   }
+   producer.join();
+
+   *bytesOut = bytes;
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double benchMutexDeque(long count, const CCommandRecord& sample, size_t* bytesOut) {
+   std::mutex lock;
+   std::deque<CCommandRecord> queue;
+   auto start = std::chrono::steady_clock::now();
+
+   std::thread producer([&]() {
+      for (long i = 0; i < count; i++) {
+         while (true) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (queue.size() < RING_CAPACITY) { queue.push_back(sample); break; }
+         }
+      }
+   });
+
+   CCommandRecord drained[DRAIN_BATCH];
+   char sendBuffer[DRAIN_BATCH * COMMAND_RECORD_SIZE];
+   size_t bytes = 0;
+   long received = 0;
+   while (received < count) {
+      size_t n = 0;
+      {
+         std::lock_guard<std::mutex> guard(lock);
+         while (n < DRAIN_BATCH && !queue.empty()) {
+            drained[n++] = queue.front();
+            queue.pop_front();
+         }
+      }
+      if (n == 0) { std::this_thread::yield(); continue; }
+      bytes += gather(drained, n, sendBuffer);
+      received += (long)n;
+   }
+   producer.join();
+
+   *bytesOut = bytes;
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+   long count = argc > 1 ? atol(argv[1]) : 4000000;
+   CCommandRecord sample = makeRecord(12345);
+   size_t ringBytes = 0, dequeBytes = 0;
+
+   double ringSeconds = benchRing(count, sample, &ringBytes);
+   double dequeSeconds = benchMutexDeque(count, sample, &dequeBytes);
+
+   printf("records: %ld (%d-byte records, drain batch %d)\n", count, COMMAND_RECORD_SIZE, DRAIN_BATCH);
+   printf("%-22s %10.3f s %12.2f Mrec/s %10.1f MB/s\n", "CSpscRing",
+          ringSeconds, count / ringSeconds / 1e6, ringBytes / ringSeconds / 1e6);
+   printf("%-22s %10.3f s %12.2f Mrec/s %10.1f MB/s\n", "mutex + deque",
+          dequeSeconds, count / dequeSeconds / 1e6, dequeBytes / dequeSeconds / 1e6);
+   printf("speedup: %.2fx\n", dequeSeconds / ringSeconds);
+   return 0;
+}
@@ -0,0 +1,247 @@
+/*|Client Transport Benchmark|-------------------------------------------------
+#
+# Streams command mixes drawn from Examples.md through every CRobot send
+# mode to an in-process loopback sink (CServerSocket + CScaraSimulator), so
+# it runs anywhere without the simulator. For each mix and mode it reports
+# commands/s and the per-command latency from submission to the sink
+# parsing the command (p50/p99/max), and fails if a command is lost.
+#
+#   send       CRobot::Send() per command, PACING_NONE
+#   batched    CRobot::SendBatch() per 64 KiB of commands
+#   async      CRobot::Enqueue() on the background sender thread
+#   pipelined  CRobot::Send() with PACING_WINDOW, the sink acknowledging
+#   io_uring   CUringWriter::Write() per command (skipped if unavailable)
+#   uring-zc   the same with zero-copy sends from registered buffers
+#              (skipped without IORING_OP_SEND_ZC)
+#
+# Usage: scara_bench [-n commands] [-p port] [-m mode] [-x mix]
+#   -n commands  commands per run (default 200000)
+#   -p port      loopback port for the sink (default 12800)
+#   -m mode      run only this mode
+#   -x mix       run only this mix: rotate, draw or examples
+# PACING_LEGACY is left out: it sleeps 200 ms per command by design.
+# -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "robot.h"
+#include "robot_stats.h"
+#include "scara_sim.h"
+#include "uring_writer.h"
+
+#define RECV_BUFFER     65536
+#define BATCH_BYTES     65536
+#define PIPELINE_WINDOW 64
+#define ACCEPT_POLL_MS  100
+
+enum Mode { MODE_SEND, MODE_BATCH, MODE_ASYNC, MODE_PIPELINED, MODE_URING, MODE_URING_ZC, MODE_COUNT };
+static const char* MODE_NAMES[] = { "send", "batched", "async", "pipelined", "io_uring", "uring-zc" };
+
+struct Result {
+   double seconds;
+   long executed;
+   CLatencyHistogram latency;
+};
+
+/// Time in ns from the commands' submission to the sink parsing them.
+struct Timeline {
+   std::vector<uint64_t> submitted;
+   std::vector<uint64_t> received;
+};
+
+// Accepts one client and executes its commands until END, timestamping
+// each command as it is parsed. Acknowledges every command if ack is set.
+// Gives up waiting for the client once abandoned is set.
+static void serve(CServerSocket* server, bool ack, Timeline* timeline, long* executed,
+                  const std::atomic<bool>* abandoned) {
+   static char buffer[RECV_BUFFER];
+   CRobot* client = NULL;
+   try {
+      while (client == NULL && !abandoned->load()) {
+         if (WaitSocket(server->GetSocket(), false, ACCEPT_POLL_MS) > 0) client = server->Accept();
+      }
+      if (client == NULL) return;
+      client->SetPacing(PACING_NONE);
+      CScaraSimulator sim;
+      size_t n = 0;
+      int nread;
+      while (!sim.IsEnded() && (nread = client->Read(buffer, RECV_BUFFER)) > 0) {
+         int lines = sim.Feed(buffer, nread);
+         uint64_t now = CRobotStats::Now();
+         for (int i = 0; i < lines && n < timeline->received.size(); i++) timeline->received[n++] = now;
+         if (ack && lines > 0) client->Send(std::string(lines, '\n').c_str());
+      }
+      *executed = sim.GetCommandCount();
+   } catch (CSocketException& e) {
+      fprintf(stderr, "sink: %s\n", e.GetMessage());
+   }
+   delete client;
+}
+
+// ROTATE_JOINT only, formatted as in Examples.md: a long pen-down stroke.
+static void mixRotate(long count, std::vector<std::string>* commands) {
+   char text[MAX_COMMAND_LINE];
+   for (long i = 0; i < count; i++) {
+      snprintf(text, sizeof(text), "ROTATE_JOINT ANG1 %.2lf ANG2 %.2lf\n", (i % 300) - 150.0 + 0.25, (i % 340) - 170.0 + 0.5);
+      commands->push_back(text);
+   }
+}
+
+// Strokes as a drawing sends them: pen up, move, pen down, eight moves, colour change.
+static void mixDraw(long count, std::vector<std::string>* commands) {
+   char text[MAX_COMMAND_LINE];
+   for (long i = 0; (long)commands->size() < count; i++) {
+      commands->push_back("PEN_UP\n");
+      snprintf(text, sizeof(text), "ROTATE_JOINT ANG1 %.2lf ANG2 %.2lf\n", (i % 90) - 45.0, -155.0 + (i % 60));
+      commands->push_back(text);
+      commands->push_back("PEN_DOWN\n");
+      for (int k = 1; k <= 8; k++) {
+         snprintf(text, sizeof(text), "ROTATE_JOINT ANG1 %.2lf ANG2 %.2lf\n", (i % 90) - 45.0 + k, -155.0 + (i % 60) + 2 * k);
+         commands->push_back(text);
+      }
+      snprintf(text, sizeof(text), "PEN_COLOR %d %d %d\n", (int)(i * 10 % 256), (int)(i * 64 % 256), (int)(i * 109 % 256));
+      commands->push_back(text);
+   }
+   commands->resize(count);
+}
+
+// The Examples.md walkthrough, repeated (without SHUTDOWN_SIMULATION and END).
+static void mixExamples(long count, std::vector<std::string>* commands) {
+   static const char* EXAMPLES[] = {
+      "CYCLE_PEN_COLORS OFF\n", "PEN_COLOR 0 0 255\n", "ROTATE_JOINT ANG1 150.00 ANG2 90.00\n",
+      "PEN_COLOR 255 0 0\n", "ROTATE_JOINT ANG1 -45.00 ANG2 -155.00\n", "PEN_UP\n",
+      "ROTATE_JOINT ANG1 150.00 ANG2 90.00\n", "PEN_DOWN\n", "ROTATE_JOINT ANG1 -45.00 ANG2 -155.00\n",
+      "PEN_COLOR 10 64 109\n", "ROTATE_JOINT ANG1 -150.00 ANG2 90.00\n", "PROCESS_MESSAGES OFF\n",
+      "MESSAGE Erasing Traces\n", "CLEAR_TRACE\n", "HOME\n", "CLEAR_REMOTE_COMMAND_LOG\n",
+      "CLEAR_POSITION_LOG\n", "MESSAGE Bye-Bye\n"
+   };
+   const long n = (long)(sizeof(EXAMPLES) / sizeof(EXAMPLES[0]));
+   for (long i = 0; i < count; i++) commands->push_back(EXAMPLES[i % n]);
+}
+
+static bool run(Mode mode, int port, const std::vector<std::string>& commands, Result* result) {
+   Timeline timeline;
+   timeline.submitted.resize(commands.size());
+   timeline.received.resize(commands.size() + 1);
+
+   CServerSocket server(port);
+   server.Listen();
+   long executed = 0;
+   std::atomic<bool> abandoned(false);
+   std::thread sink(serve, &server, mode == MODE_PIPELINED, &timeline, &executed, &abandoned);
+
+   CRobot robot;
+   if (!robot.Connect("127.0.0.1", port)) {
+      abandoned = true;
+      sink.join();
+      return false;
+   }
+   robot.SetPacing(mode == MODE_PIPELINED ? PACING_WINDOW : PACING_NONE, PIPELINE_WINDOW, 1000);
+   CUringWriter writer(&robot);
+   if ((mode == MODE_URING || mode == MODE_URING_ZC) && !writer.Open(mode == MODE_URING_ZC)) {
+      robot.Send("END\n");
+      sink.join();
+      return false;
+   }
+   if (mode == MODE_URING_ZC && !writer.IsZeroCopy()) {
+      writer.Close();
+      robot.Send("END\n");
+      sink.join();
+      return false;
+   }
+
+   uint64_t start = CRobotStats::Now();
+   if (mode == MODE_SEND || mode == MODE_PIPELINED) {
+      for (size_t i = 0; i < commands.size(); i++) {
+         timeline.submitted[i] = CRobotStats::Now();
+         robot.Send(commands[i].c_str());
+      }
+      robot.Send("END\n");
+   } else if (mode == MODE_BATCH) {
+      CCommandBatch batch;
+      for (size_t i = 0; i < commands.size(); i++) {
+         timeline.submitted[i] = CRobotStats::Now();
+         batch.Add(commands[i].data(), (int)commands[i].size());
+         if (batch.GetLength() >= BATCH_BYTES - MAX_COMMAND_LINE) {
+            robot.SendBatch(batch);
+            batch.Clear();
+         }
+      }
+      batch.Add("END\n");
+      robot.SendBatch(batch);
+   } else if (mode == MODE_ASYNC) {
+      robot.StartAsync();
+      for (size_t i = 0; i < commands.size(); i++) {
+         timeline.submitted[i] = CRobotStats::Now();
+         robot.Enqueue(commands[i].c_str());
+      }
+      robot.Enqueue("END\n");
+      robot.StopAsync();
+   } else {
+      for (size_t i = 0; i < commands.size(); i++) {
+         timeline.submitted[i] = CRobotStats::Now();
+         writer.Write(commands[i].data(), (int)commands[i].size());
+      }
+      writer.Write("END\n", 4);
+      writer.Flush();
+   }
+   sink.join();
+
+   result->seconds = (CRobotStats::Now() - start) / 1e9;
+   result->executed = executed;
+   result->latency.Reset();
+   for (size_t i = 0; i < commands.size(); i++)
+      if (timeline.received[i] >= timeline.submitted[i])
+         result->latency.Record(timeline.received[i] - timeline.submitted[i]);
+   return true;
+}
+
+int main(int argc, char** argv) {
+   long count = 200000;
+   int port = 12800;
+   const char* onlyMode = NULL;
+   const char* onlyMix = NULL;
+   for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) count = atol(argv[++i]);
+      else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) port = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) onlyMode = argv[++i];
+      else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) onlyMix = argv[++i];
+      else {
+         fprintf(stderr, "usage: %s [-n commands] [-p port] [-m mode] [-x mix]\n", argv[0]);
+         return 1;
+      }
+   }
+   CWinSock::Initialize();
+
+   const char* mixNames[] = { "rotate", "draw", "examples" };
+   void (*mixes[])(long, std::vector<std::string>*) = { mixRotate, mixDraw, mixExamples };
+
+   printf("%ld commands per run over loopback\n", count);
+   printf("%-9s %-10s %10s %14s %10s %10s %10s\n", "mix", "mode", "seconds", "commands/s", "p50 us", "p99 us", "max us");
+   int failures = 0;
+   static Result result;
+   for (int x = 0; x < 3; x++) {
+      if (onlyMix != NULL && strcmp(onlyMix, mixNames[x]) != 0) continue;
+      std::vector<std::string> commands;
+      mixes[x](count, &commands);
+      for (int mode = 0; mode < MODE_COUNT; mode++) {
+         if (onlyMode != NULL && strcmp(onlyMode, MODE_NAMES[mode]) != 0) continue;
+         if (!run((Mode)mode, port, commands, &result)) {
+            printf("%-9s %-10s %10s\n", mixNames[x], MODE_NAMES[mode], "unavailable");
+            continue;
+         }
+         bool lost = result.executed != count + 1;
+         if (lost) failures++;
+         printf("%-9s %-10s %10.3f %14.0f %10.1f %10.1f %10.1f%s\n", mixNames[x], MODE_NAMES[mode], result.seconds,
+                count / result.seconds, result.latency.GetPercentile(50) / 1e3, result.latency.GetPercentile(99) / 1e3,
+                result.latency.GetMax() / 1e3, lost ? "  COMMANDS LOST" : "");
+      }
+   }
+   CWinSock::Finalize();
+   return failures == 0 ? 0 : 1;
+}
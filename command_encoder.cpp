@@ -0,0 +1,182 @@
+#include <cmath>
+#include <cstring>
+#include "command_encoder.h"
+using namespace openutils;
+
+#define LITERAL(s) s, (int)(sizeof(s) - 1)
+
+CCommandEncoder::CCommandEncoder(char* buffer,int capacity)
+{
+   m_buffer = buffer;
+   m_nCapacity = capacity;
+   m_nLength = 0;
+   m_bOverflow = false;
+}
+
+void CCommandEncoder::Reset()
+{
+   m_nLength = 0;
+   m_bOverflow = false;
+}
+
+CCommandEncoder& CCommandEncoder::PenUp() { return Keyword(LITERAL("PEN_UP\n")); }
+CCommandEncoder& CCommandEncoder::PenDown() { return Keyword(LITERAL("PEN_DOWN\n")); }
+CCommandEncoder& CCommandEncoder::ClearTrace() { return Keyword(LITERAL("CLEAR_TRACE\n")); }
+CCommandEncoder& CCommandEncoder::ClearRemoteCommandLog() { return Keyword(LITERAL("CLEAR_REMOTE_COMMAND_LOG\n")); }
+CCommandEncoder& CCommandEncoder::ClearPositionLog() { return Keyword(LITERAL("CLEAR_POSITION_LOG\n")); }
+CCommandEncoder& CCommandEncoder::ShutdownSimulation() { return Keyword(LITERAL("SHUTDOWN_SIMULATION\n")); }
+CCommandEncoder& CCommandEncoder::Home() { return Keyword(LITERAL("HOME\n")); }
+CCommandEncoder& CCommandEncoder::End() { return Keyword(LITERAL("END\n")); }
+
+CCommandEncoder& CCommandEncoder::CyclePenColors(bool on)
+{
+   return on ? Keyword(LITERAL("CYCLE_PEN_COLORS ON\n")) : Keyword(LITERAL("CYCLE_PEN_COLORS OFF\n"));
+}
+
+CCommandEncoder& CCommandEncoder::ProcessMessages(bool on)
+{
+   return on ? Keyword(LITERAL("PROCESS_MESSAGES ON\n")) : Keyword(LITERAL("PROCESS_MESSAGES OFF\n"));
+}
+
+CCommandEncoder& CCommandEncoder::SetMotorSpeed(MotorSpeed speed)
+{
+   switch(speed)
+   {
+      case MOTOR_SPEED_HIGH: return Keyword(LITERAL("MOTOR_SPEED HIGH\n"));
+      case MOTOR_SPEED_MEDIUM: return Keyword(LITERAL("MOTOR_SPEED MEDIUM\n"));
+      default: return Keyword(LITERAL("MOTOR_SPEED LOW\n"));
+   }
+}
+
+/**
+* PEN_COLOR <r> <g> <b>. Components are clamped to 0..255.
+*/
+CCommandEncoder& CCommandEncoder::PenColor(int r,int g,int b)
+{
+   if(!Begin(sizeof("PEN_COLOR 255 255 255\n") - 1)) return *this;
+   Put(LITERAL("PEN_COLOR "));
+   PutInt(r < 0 ? 0 : r > 255 ? 255 : r);
+   Put(LITERAL(" "));
+   PutInt(g < 0 ? 0 : g > 255 ? 255 : g);
+   Put(LITERAL(" "));
+   PutInt(b < 0 ? 0 : b > 255 ? 255 : b);
+   Put(LITERAL("\n"));
+   return *this;
+}
+
+/**
+* ROTATE_JOINT ANG1 <deg1> ANG2 <deg2> with two decimals, byte-for-byte
+* what "%.2lf" produces for joint-range angles. Non-finite angles are
+* rejected like a command that does not fit.
+*/
+CCommandEncoder& CCommandEncoder::RotateJoint(double ang1,double ang2)
+{
+   char angle1[32],angle2[32];
+   int len1 = FormatFixed2(angle1,ang1);
+   int len2 = FormatFixed2(angle2,ang2);
+   if(len1 == 0 || len2 == 0)
+   {
+      m_bOverflow = true;
+      return *this;
+   }
+   if(!Begin((int)sizeof("ROTATE_JOINT ANG1  ANG2 \n") - 1 + len1 + len2)) return *this;
+   Put(LITERAL("ROTATE_JOINT ANG1 "));
+   Put(angle1,len1);
+   Put(LITERAL(" ANG2 "));
+   Put(angle2,len2);
+   Put(LITERAL("\n"));
+   return *this;
+}
+
+/**
+* MESSAGE <text>. Line breaks inside text are replaced by spaces so the
+* message cannot split into a second, unknown command.
+*/
+CCommandEncoder& CCommandEncoder::Message(const char* text)
+{
+   int len = (int)strlen(text);
+   if(!Begin((int)sizeof("MESSAGE \n") - 1 + len)) return *this;
+   Put(LITERAL("MESSAGE "));
+   for(int i = 0; i < len; i++)
+      m_buffer[m_nLength++] = (text[i] == '\n' || text[i] == '\r') ? ' ' : text[i];
+   Put(LITERAL("\n"));
+   return *this;
+}
+
+/**
+* Writes value rounded to two decimals, matching printf("%.2f") including
+* round-half-to-even on exact ties and the sign of negative zero. Uses
+* integer arithmetic only, so the output never depends on the locale.
+* Returns the number of characters written (at most 24), or 0 if value is
+* not finite or too large to represent.
+* @param out Destination, at least 24 bytes
+* @param value Value to format
+*/
+int CCommandEncoder::FormatFixed2(char* out,double value)
+{
+   if(!(fabs(value) < 1e15)) return 0;
+
+   // Round |value| * 100 to an integer. The product is rounded once, so an
+   // apparent tie is resolved with the exact product error from fma().
+   double product = fabs(value) * 100.0;
+   double floorProduct = floor(product);
+   double fractionPart = product - floorProduct;
+   long long scaled = (long long)floorProduct;
+   if(fractionPart > 0.5)
+      scaled++;
+   else if(fractionPart == 0.5)
+   {
+      double error = fma(fabs(value),100.0,-product);
+      if(error > 0 || (error == 0 && (scaled & 1))) scaled++;
+   }
+   long long whole = scaled / 100;
+   int fraction = (int)(scaled % 100);
+   char digits[20];
+   int nDigits = 0,len = 0;
+
+   if(std::signbit(value)) out[len++] = '-';
+   do
+   {
+      digits[nDigits++] = (char)('0' + whole % 10);
+      whole /= 10;
+   } while(whole > 0);
+   while(nDigits > 0) out[len++] = digits[--nDigits];
+   out[len++] = '.';
+   out[len++] = (char)('0' + fraction / 10);
+   out[len++] = (char)('0' + fraction % 10);
+   return len;
+}
+
+CCommandEncoder& CCommandEncoder::Keyword(const char* keyword,int len)
+{
+   if(Begin(len)) Put(keyword,len);
+   return *this;
+}
+
+bool CCommandEncoder::Begin(int maxLength)
+{
+   if(m_nLength + maxLength > m_nCapacity)
+   {
+      m_bOverflow = true;
+      return false;
+   }
+   return true;
+}
+
+void CCommandEncoder::Put(const char* text,int len)
+{
+   memcpy(m_buffer + m_nLength,text,len);
+   m_nLength += len;
+}
+
+void CCommandEncoder::PutInt(int value)
+{
+   char digits[12];
+   int nDigits = 0;
+   do
+   {
+      digits[nDigits++] = (char)('0' + value % 10);
+      value /= 10;
+   } while(value > 0);
+   while(nDigits > 0) m_buffer[m_nLength++] = digits[--nDigits];
+}
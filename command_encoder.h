@@ -0,0 +1,58 @@
+#ifndef _COMMAND_ENCODER_H_
+#define _COMMAND_ENCODER_H_
+
+namespace openutils
+{
+   /// Arguments of MOTOR_SPEED.
+   enum MotorSpeed
+   {
+      MOTOR_SPEED_HIGH,
+      MOTOR_SPEED_MEDIUM,
+      MOTOR_SPEED_LOW
+   };
+
+   /**
+   * Encodes simulator commands (see "robot commands.txt") straight into a
+   * caller-provided buffer. Every command is written whole, ending in '\n',
+   * or not at all: if it does not fit, the buffer is left unchanged and the
+   * overflow flag is set. Nothing allocates and nothing depends on the
+   * C locale, so encoders may be used from any thread.
+   */
+   class CCommandEncoder
+   {
+   private:
+      char* m_buffer; /// destination buffer
+      int m_nCapacity; /// size of m_buffer
+      int m_nLength; /// bytes written so far
+      bool m_bOverflow; /// true once a command did not fit
+   public:
+      CCommandEncoder(char* buffer,int capacity); /// Encodes into buffer
+      CCommandEncoder& PenUp(); /// PEN_UP
+      CCommandEncoder& PenDown(); /// PEN_DOWN
+      CCommandEncoder& PenColor(int r,int g,int b); /// PEN_COLOR <r> <g> <b>
+      CCommandEncoder& CyclePenColors(bool on); /// CYCLE_PEN_COLORS ON/OFF
+      CCommandEncoder& RotateJoint(double ang1,double ang2); /// ROTATE_JOINT ANG1 <deg1> ANG2 <deg2>
+      CCommandEncoder& ClearTrace(); /// CLEAR_TRACE
+      CCommandEncoder& ClearRemoteCommandLog(); /// CLEAR_REMOTE_COMMAND_LOG
+      CCommandEncoder& ClearPositionLog(); /// CLEAR_POSITION_LOG
+      CCommandEncoder& ShutdownSimulation(); /// SHUTDOWN_SIMULATION
+      CCommandEncoder& SetMotorSpeed(MotorSpeed speed); /// MOTOR_SPEED HIGH/MEDIUM/LOW
+      CCommandEncoder& ProcessMessages(bool on); /// PROCESS_MESSAGES ON/OFF
+      CCommandEncoder& Message(const char* text); /// MESSAGE <"string">
+      CCommandEncoder& Home(); /// HOME
+      CCommandEncoder& End(); /// END
+      const char* GetData() { return m_buffer; } /// Returns the encoded bytes (not NUL-terminated)
+      int GetLength() { return m_nLength; } /// Returns the number of encoded bytes
+      bool Overflowed() { return m_bOverflow; } /// Returns true if any command was dropped
+      void Reset(); /// Discards everything encoded so far
+
+      static int FormatFixed2(char* out,double value); /// Writes value like "%.2f", returns length
+   private:
+      CCommandEncoder& Keyword(const char* keyword,int len); /// Appends a command with no arguments
+      bool Begin(int maxLength); /// Checks that maxLength more bytes fit
+      void Put(const char* text,int len); /// Appends raw bytes
+      void PutInt(int value); /// Appends a decimal integer
+   };
+}
+
+#endif
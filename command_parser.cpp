@@ -0,0 +1,392 @@
+#include <cstdlib>
+#include <cstring>
+#include <clocale>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#include "command_parser.h"
+using namespace openutils;
+
+#define LITERAL(s) s, (int)(sizeof(s) - 1)
+
+/// strtod in the "C" locale, whatever the process locale is.
+static double strtodC(const char* text)
+{
+#ifdef _WIN32
+   static const _locale_t cLocale = _create_locale(LC_NUMERIC,"C");
+   return _strtod_l(text,NULL,cLocale);
+#else
+   static const locale_t cLocale = newlocale(LC_NUMERIC_MASK,"C",(locale_t)0);
+   return strtod_l(text,NULL,cLocale);
+#endif
+}
+
+/// Keyword table, scanned in order; each entry's length is compared before its bytes.
+static const struct
+{
+   const char* name;
+   int length;
+   CommandType type;
+} KEYWORDS[] =
+{
+   { LITERAL("ROTATE_JOINT"), CMD_ROTATE_JOINT },
+   { LITERAL("PEN_UP"), CMD_PEN_UP },
+   { LITERAL("PEN_DOWN"), CMD_PEN_DOWN },
+   { LITERAL("PEN_COLOR"), CMD_PEN_COLOR },
+   { LITERAL("CYCLE_PEN_COLORS"), CMD_CYCLE_PEN_COLORS },
+   { LITERAL("CLEAR_TRACE"), CMD_CLEAR_TRACE },
+   { LITERAL("CLEAR_REMOTE_COMMAND_LOG"), CMD_CLEAR_REMOTE_COMMAND_LOG },
+   { LITERAL("CLEAR_POSITION_LOG"), CMD_CLEAR_POSITION_LOG },
+   { LITERAL("SHUTDOWN_SIMULATION"), CMD_SHUTDOWN_SIMULATION },
+   { LITERAL("MOTOR_SPEED"), CMD_MOTOR_SPEED },
+   { LITERAL("PROCESS_MESSAGES"), CMD_PROCESS_MESSAGES },
+   { LITERAL("MESSAGE"), CMD_MESSAGE },
+   { LITERAL("HOME"), CMD_HOME },
+   { LITERAL("END"), CMD_END }
+};
+
+CCommandParser::CCommandParser()
+{
+   m_data = NULL;
+   m_nLength = 0;
+   m_nPos = 0;
+   Reset();
+}
+
+void CCommandParser::Reset()
+{
+   m_nCarry = 0;
+   m_bCarryTooLong = false;
+}
+
+/**
+* Sets the chunk that the following Next() calls parse. The chunk must stay
+* valid until Next() returns false; its trailing partial line is copied.
+* @param data Received bytes
+* @param len Number of bytes
+*/
+void CCommandParser::Feed(const char* data,int len)
+{
+   m_data = data;
+   m_nLength = len > 0 ? len : 0;
+   m_nPos = 0;
+}
+
+static bool isSeparator(char c)
+{
+   return c == ' ' || c == '\t';
+}
+
+/**
+* Returns the next complete, non-blank line of the current chunk in cmd,
+* parsed or with cmd->error set. Returns false once the chunk holds no
+* more complete lines; the remainder is kept for the next Feed().
+* @param cmd Receives the command
+*/
+bool CCommandParser::Next(CParsedCommand* cmd)
+{
+   while(m_nPos < m_nLength)
+   {
+      const char* start = m_data + m_nPos;
+      int avail = m_nLength - m_nPos;
+      const char* newline = (const char*)memchr(start,'\n',avail);
+      if(newline == NULL)
+      {
+         Carry(start,avail);
+         m_nPos = m_nLength;
+         return false;
+      }
+
+      const char* line = start;
+      int len = (int)(newline - start);
+      bool tooLong = false;
+      m_nPos += len + 1;
+      if(HasPartial())
+      {
+         Carry(start,len);
+         line = m_carry;
+         len = m_nCarry;
+         tooLong = m_bCarryTooLong;
+         Reset();
+      }
+      if(len > 0 && line[len-1] == '\r') len--;
+
+      int i = 0;
+      while(i < len && isSeparator(line[i])) i++;
+      if(i == len && !tooLong) continue;
+
+      if(tooLong)
+      {
+         cmd->line.data = line;
+         cmd->line.length = len;
+         cmd->error = PARSE_TOO_LONG;
+      }
+      else ParseLine(line,len,cmd);
+      return true;
+   }
+   return false;
+}
+
+/**
+* Keeps the start of a line that continues in the next chunk. Bytes past
+* MAX_COMMAND_LINE are dropped and the line is reported as too long.
+*/
+void CCommandParser::Carry(const char* data,int len)
+{
+   int room = MAX_COMMAND_LINE - m_nCarry;
+   if(len > room)
+   {
+      len = room;
+      m_bCarryTooLong = true;
+   }
+   memcpy(m_carry + m_nCarry,data,len);
+   m_nCarry += len;
+}
+
+/// Splits off the next separator-delimited token. Returns false at the end.
+static bool nextToken(const char** p,const char* end,CTextView* token)
+{
+   const char* s = *p;
+   while(s < end && isSeparator(*s)) s++;
+   if(s == end) return false;
+   const char* e = s;
+   while(e < end && !isSeparator(*e)) e++;
+   token->data = s;
+   token->length = (int)(e - s);
+   *p = e;
+   return true;
+}
+
+static bool equals(const CTextView& token,const char* text,int len)
+{
+   return token.length == len && memcmp(token.data,text,len) == 0;
+}
+
+/// Parses a token that must be a decimal integer in [lo, hi].
+static bool parseInt(const CTextView& token,int lo,int hi,int* value)
+{
+   const char* p = token.data;
+   const char* end = p + token.length;
+   bool negative = false;
+   if(p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+   if(p == end) return false;
+   long v = 0;
+   for(; p < end; p++)
+   {
+      if(*p < '0' || *p > '9') return false;
+      v = v * 10 + (*p - '0');
+      if(v > 1000000) return false;
+   }
+   if(negative) v = -v;
+   if(v < lo || v > hi) return false;
+   *value = (int)v;
+   return true;
+}
+
+/// Parses a token that must be exactly ON or OFF.
+static bool parseSwitch(const CTextView& token,bool* on)
+{
+   if(equals(token,LITERAL("ON"))) *on = true;
+   else if(equals(token,LITERAL("OFF"))) *on = false;
+   else return false;
+   return true;
+}
+
+/**
+* Parses one command line, given without its '\n'. Tokens are separated by
+* spaces or tabs and are not copied; cmd->line and cmd->text point into line.
+* Returns (and stores in cmd->error) PARSE_OK or the reason for rejecting it.
+* @param line Command text
+* @param len Number of bytes
+* @param cmd Receives the command
+*/
+ParseError CCommandParser::ParseLine(const char* line,int len,CParsedCommand* cmd)
+{
+   cmd->line.data = line;
+   cmd->line.length = len;
+   if(len > MAX_COMMAND_LINE) return cmd->error = PARSE_TOO_LONG;
+
+   const char* p = line;
+   const char* end = line + len;
+   CTextView keyword,token;
+   if(!nextToken(&p,end,&keyword)) return cmd->error = PARSE_UNKNOWN_COMMAND;
+
+   int k = 0;
+   const int count = (int)(sizeof(KEYWORDS) / sizeof(KEYWORDS[0]));
+   while(k < count && !equals(keyword,KEYWORDS[k].name,KEYWORDS[k].length)) k++;
+   if(k == count) return cmd->error = PARSE_UNKNOWN_COMMAND;
+   cmd->type = KEYWORDS[k].type;
+
+   switch(cmd->type)
+   {
+      case CMD_ROTATE_JOINT:
+      {
+         // ANG1 <deg1> ANG2 <deg2>, in either order
+         bool seen1 = false,seen2 = false;
+         while(nextToken(&p,end,&token))
+         {
+            CTextView number;
+            bool first = equals(token,LITERAL("ANG1"));
+            if(!first && !equals(token,LITERAL("ANG2"))) return cmd->error = PARSE_INVALID_ARGUMENTS;
+            if((first ? seen1 : seen2) || !nextToken(&p,end,&number)) return cmd->error = PARSE_INVALID_ARGUMENTS;
+            const char* numberEnd = number.data + number.length;
+            if(ParseNumber(number.data,numberEnd,first ? &cmd->ang1 : &cmd->ang2) != numberEnd)
+               return cmd->error = PARSE_INVALID_ARGUMENTS;
+            (first ? seen1 : seen2) = true;
+         }
+         if(!seen1 || !seen2) return cmd->error = PARSE_INVALID_ARGUMENTS;
+         return cmd->error = PARSE_OK;
+      }
+      case CMD_PEN_COLOR:
+      {
+         int* rgb[3] = { &cmd->r,&cmd->g,&cmd->b };
+         for(int i = 0; i < 3; i++)
+         {
+            if(!nextToken(&p,end,&token) || !parseInt(token,0,255,rgb[i])) return cmd->error = PARSE_INVALID_ARGUMENTS;
+         }
+         break;
+      }
+      case CMD_CYCLE_PEN_COLORS:
+      case CMD_PROCESS_MESSAGES:
+         if(!nextToken(&p,end,&token) || !parseSwitch(token,&cmd->on)) return cmd->error = PARSE_INVALID_ARGUMENTS;
+         break;
+      case CMD_MOTOR_SPEED:
+         if(!nextToken(&p,end,&token)) return cmd->error = PARSE_INVALID_ARGUMENTS;
+         if(equals(token,LITERAL("HIGH"))) cmd->speed = MOTOR_SPEED_HIGH;
+         else if(equals(token,LITERAL("MEDIUM"))) cmd->speed = MOTOR_SPEED_MEDIUM;
+         else if(equals(token,LITERAL("LOW"))) cmd->speed = MOTOR_SPEED_LOW;
+         else return cmd->error = PARSE_INVALID_ARGUMENTS;
+         break;
+      case CMD_MESSAGE:
+      {
+         // Everything after the keyword, without one pair of enclosing quotes
+         while(p < end && isSeparator(*p)) p++;
+         if(end - p >= 2 && *p == '"' && end[-1] == '"')
+         {
+            p++;
+            end--;
+         }
+         cmd->text.data = p;
+         cmd->text.length = (int)(end - p);
+         return cmd->error = PARSE_OK;
+      }
+      default:
+         break;
+   }
+
+   // Nothing may follow the expected arguments
+   if(nextToken(&p,end,&token)) return cmd->error = PARSE_INVALID_ARGUMENTS;
+   return cmd->error = PARSE_OK;
+}
+
+const char* CCommandParser::GetErrorText(ParseError error)
+{
+   switch(error)
+   {
+      case PARSE_OK: return "";
+      case PARSE_UNKNOWN_COMMAND: return "Unknown Command!";
+      case PARSE_INVALID_ARGUMENTS: return "Invalid Arguments!";
+      default: return "Command Too Long!";
+   }
+}
+
+/**
+* Parses [+-]digits[.digits][(e|E)[+-]digits] at the start of [first, last)
+* into value, like std::from_chars: no leading spaces, no locale, and the
+* result is correctly rounded. Numbers with at most 19 significant digits
+* and a decimal exponent within +/-22 (everything the encoder writes) are
+* converted exactly with one multiplication or division; others fall back
+* to strtod in the "C" locale on a stack copy, which holds any number that
+* fits in a MAX_COMMAND_LINE line. Returns the end of the number, or NULL if
+* there is none or it is longer than that.
+* @param first First character
+* @param last One past the last character
+* @param value Receives the number
+*/
+const char* CCommandParser::ParseNumber(const char* first,const char* last,double* value)
+{
+   static const double POW10[] =
+   {
+      1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+      1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22
+   };
+   const char* p = first;
+   bool negative = false;
+   if(p < last && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+   unsigned long long mantissa = 0;
+   int digits = 0,exponent = 0;
+   bool any = false,exact = true;
+   for(; p < last && *p >= '0' && *p <= '9'; p++)
+   {
+      any = true;
+      if(digits < 19)
+      {
+         mantissa = mantissa * 10 + (*p - '0');
+         if(mantissa != 0) digits++;
+      }
+      else
+      {
+         exponent++;
+         if(*p != '0') exact = false;
+      }
+   }
+   if(p < last && *p == '.')
+   {
+      const char* fraction = ++p;
+      for(; p < last && *p >= '0' && *p <= '9'; p++)
+      {
+         if(digits < 19)
+         {
+            mantissa = mantissa * 10 + (*p - '0');
+            if(mantissa != 0) digits++;
+            exponent--;
+         }
+         else if(*p != '0') exact = false;
+      }
+      any = any || p > fraction;
+   }
+   if(!any) return NULL;
+
+   if(p < last && (*p == 'e' || *p == 'E'))
+   {
+      // Only part of the number if digits follow
+      const char* q = p + 1;
+      bool negativeExp = false;
+      if(q < last && (*q == '-' || *q == '+')) negativeExp = *q++ == '-';
+      if(q < last && *q >= '0' && *q <= '9')
+      {
+         int e = 0;
+         for(; q < last && *q >= '0' && *q <= '9'; q++)
+         {
+            if(e < 100000) e = e * 10 + (*q - '0');
+         }
+         exponent += negativeExp ? -e : e;
+         p = q;
+      }
+   }
+
+   double v;
+   if(mantissa == 0 && exact)
+   {
+      v = 0.0;
+   }
+   else if(exact && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+   {
+      // Both operands are exact doubles, so the single operation rounds correctly
+      v = exponent < 0 ? (double)mantissa / POW10[-exponent] : (double)mantissa * POW10[exponent];
+   }
+   else
+   {
+      // A number never outruns its line, so within a command the copy always fits
+      char copy[MAX_COMMAND_LINE + 1];
+      size_t n = (size_t)(p - first);
+      if(n > MAX_COMMAND_LINE) return NULL;
+      memcpy(copy,first,n);
+      copy[n] = '\0';
+      *value = strtodC(copy);
+      return p;
+   }
+   *value = negative ? -v : v;
+   return p;
+}
@@ -0,0 +1,93 @@
+#ifndef _COMMAND_PARSER_H_
+#define _COMMAND_PARSER_H_
+
+#include "command_encoder.h"
+
+#define MAX_COMMAND_LINE  1024 /// longest command line accepted
+
+namespace openutils
+{
+   /// Simulator commands, see "robot commands.txt".
+   enum CommandType
+   {
+      CMD_ROTATE_JOINT,
+      CMD_PEN_UP,
+      CMD_PEN_DOWN,
+      CMD_PEN_COLOR,
+      CMD_CYCLE_PEN_COLORS,
+      CMD_CLEAR_TRACE,
+      CMD_CLEAR_REMOTE_COMMAND_LOG,
+      CMD_CLEAR_POSITION_LOG,
+      CMD_SHUTDOWN_SIMULATION,
+      CMD_MOTOR_SPEED,
+      CMD_PROCESS_MESSAGES,
+      CMD_MESSAGE,
+      CMD_HOME,
+      CMD_END
+   };
+
+   /// Why a line could not be parsed.
+   enum ParseError
+   {
+      PARSE_OK,
+      PARSE_UNKNOWN_COMMAND,
+      PARSE_INVALID_ARGUMENTS,
+      PARSE_TOO_LONG
+   };
+
+   /// Bytes inside a buffer owned by someone else (not NUL-terminated).
+   struct CTextView
+   {
+      const char* data; /// first byte
+      int length; /// number of bytes
+   };
+
+   /// One parsed command line. Only the fields of its type are set.
+   struct CParsedCommand
+   {
+      CommandType type; /// command keyword, valid if error is PARSE_OK
+      ParseError error; /// PARSE_OK or the reason the line was rejected
+      CTextView line; /// the line without its '\n', valid until the next Next()/Feed()
+      double ang1,ang2; /// CMD_ROTATE_JOINT angles in degrees
+      int r,g,b; /// CMD_PEN_COLOR components, 0..255
+      bool on; /// CMD_CYCLE_PEN_COLORS and CMD_PROCESS_MESSAGES state
+      MotorSpeed speed; /// CMD_MOTOR_SPEED argument
+      CTextView text; /// CMD_MESSAGE text, quotes removed
+   };
+
+   /**
+   * Incremental parser for the newline-delimited simulator protocol. Feed()
+   * hands it a received chunk and Next() returns the chunk's lines one by
+   * one, tokenised in place. A line split across chunks is carried in a
+   * fixed buffer, so parsing never allocates. Typical use:
+   *
+   *    parser.Feed(buffer,nread);
+   *    while(parser.Next(&cmd)) { ... }
+   *
+   * Next() must return false before the next Feed().
+   */
+   class CCommandParser
+   {
+   private:
+      char m_carry[MAX_COMMAND_LINE]; /// start of a line split across chunks
+      int m_nCarry; /// bytes in m_carry
+      bool m_bCarryTooLong; /// the carried line exceeded MAX_COMMAND_LINE
+      const char* m_data; /// current chunk
+      int m_nLength; /// size of the current chunk
+      int m_nPos; /// next unparsed byte of the current chunk
+   public:
+      CCommandParser(); /// Starts with no partial line
+      void Feed(const char* data,int len); /// Sets the next received chunk
+      bool Next(CParsedCommand* cmd); /// Parses the next complete line, false when the chunk is used up
+      void Reset(); /// Drops any partial line
+      bool HasPartial() { return m_nCarry > 0 || m_bCarryTooLong; } /// True if a line is waiting for its '\n'
+
+      static ParseError ParseLine(const char* line,int len,CParsedCommand* cmd); /// Parses one line without its '\n'
+      static const char* GetErrorText(ParseError error); /// Returns the simulator's message for error
+      static const char* ParseNumber(const char* first,const char* last,double* value); /// Parses a decimal number, returns the end or NULL
+   private:
+      void Carry(const char* data,int len); /// Appends to the carried partial line
+   };
+}
+
+#endif
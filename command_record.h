@@ -0,0 +1,29 @@
+#ifndef _COMMAND_RECORD_H_
+#define _COMMAND_RECORD_H_
+
+#include <cstring>
+
+#define COMMAND_RECORD_SIZE  64  /// one cache line per record
+#define MAX_COMMAND_LENGTH   (COMMAND_RECORD_SIZE - 2) /// longest command a record can hold
+
+namespace openutils
+{
+   /// A pre-encoded, newline-terminated simulator command stored inline so it
+   /// can be copied through a queue without touching the heap.
+   struct CCommandRecord
+   {
+      unsigned short length; /// bytes used in data, including the '\n'
+      char data[MAX_COMMAND_LENGTH]; /// command text, not NUL-terminated
+
+      /// Stores len bytes of command text. Returns false if it does not fit.
+      bool Set(const char* text,int len)
+      {
+         if(len < 0 || len > MAX_COMMAND_LENGTH) return false;
+         memcpy(data,text,len);
+         length = (unsigned short)len;
+         return true;
+      }
+   };
+}
+
+#endif
@@ -0,0 +1,268 @@
+#include <vector>
+#include "event_loop.h"
+#ifdef __linux__
+#include <sys/epoll.h>
+#define EVENT_LOOP_EPOLL 1
+#endif
+using namespace openutils;
+
+CEventLoop::CEventLoop() throw (CSocketException)
+{
+   m_bStopping = false;
+   m_dispatching = INVALID_SOCKET;
+   m_bDispatchRemoved = false;
+   m_epoll = INVALID_SOCKET;
+#ifdef EVENT_LOOP_EPOLL
+   m_epoll = epoll_create1(EPOLL_CLOEXEC);
+   if(m_epoll == INVALID_SOCKET)
+      throw CSocketException(WSAGetLastError(), "Failed to create epoll: CEventLoop()");
+#endif
+}
+
+CEventLoop::~CEventLoop()
+{
+#ifdef EVENT_LOOP_EPOLL
+   close(m_epoll);
+#endif
+}
+
+const char* CEventLoop::GetBackend()
+{
+#ifdef EVENT_LOOP_EPOLL
+   return "epoll";
+#else
+   return "select";
+#endif
+}
+
+/**
+* Starts watching a connection. The socket is made non-blocking; handler
+* runs on the loop's thread whenever the connection is ready.
+* @param robot Connected CRobot
+* @param handler Called with the connection and a mask of EventFlags
+*/
+void CEventLoop::Add(CRobot* robot,RobotHandler handler) throw (CSocketException)
+{
+   robot->SetNonBlocking(true);
+   SOCKET s = robot->GetSocket();
+   CEntry& entry = m_entries[s];
+   entry.robot = robot;
+   entry.server = NULL;
+   entry.onEvent = handler;
+   entry.interest = 0;
+   Watch(s,entry,EVENT_READ,true);
+}
+
+/**
+* Starts listening on a server and accepts clients as they arrive. Each
+* accepted CRobot is passed to handler, which usually Add()s it.
+* @param server Server to listen on
+* @param handler Called with every accepted client
+*/
+void CEventLoop::Add(CServerSocket* server,AcceptHandler handler) throw (CSocketException)
+{
+   server->Listen();
+   SetSocketBlocking(server->GetSocket(),false);
+   SOCKET s = server->GetSocket();
+   CEntry& entry = m_entries[s];
+   entry.robot = NULL;
+   entry.server = server;
+   entry.onAccept = handler;
+   entry.interest = 0;
+   Watch(s,entry,EVENT_READ,true);
+}
+
+void CEventLoop::Remove(CRobot* robot)
+{
+   unordered_map<SOCKET,CEntry>::iterator it = m_entries.find(robot->GetSocket());
+   if(it != m_entries.end() && it->second.robot == robot) Unwatch(it->first);
+}
+
+void CEventLoop::Remove(CServerSocket* server)
+{
+   unordered_map<SOCKET,CEntry>::iterator it = m_entries.find(server->GetSocket());
+   if(it != m_entries.end() && it->second.server == server) Unwatch(it->first);
+}
+
+/**
+* Sets which readiness the backend reports for s. Only epoll keeps state;
+* select() rebuilds its sets from m_entries on every wait, so a new socket
+* that its fd_set cannot hold is rejected here.
+*/
+void CEventLoop::Watch(SOCKET s,CEntry& entry,int interest,bool added) throw (CSocketException)
+{
+   if(!added && entry.interest == interest) return;
+#ifdef EVENT_LOOP_EPOLL
+   epoll_event ev;
+   ev.events = ((interest & EVENT_READ) ? (uint32_t)EPOLLIN : (uint32_t)0) | ((interest & EVENT_WRITE) ? (uint32_t)EPOLLOUT : (uint32_t)0);
+   ev.data.fd = s;
+   if(epoll_ctl(m_epoll,added ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,s,&ev) == -1)
+   {
+      int nret = WSAGetLastError();
+      if(added) m_entries.erase(s);
+      throw CSocketException(nret, "Failed to watch socket: Watch()");
+   }
+#else
+#ifdef _WIN32
+   bool fits = m_entries.size() <= FD_SETSIZE; // a Winsock fd_set is an array of FD_SETSIZE sockets
+#else
+   bool fits = s >= 0 && s < FD_SETSIZE; // a POSIX fd_set is a bitmap of descriptors below FD_SETSIZE
+#endif
+   if(added && !fits)
+   {
+      m_entries.erase(s);
+      throw CSocketException(0, "Too many sockets for select(): Watch()");
+   }
+#endif
+   entry.interest = interest;
+}
+
+/**
+* Forgets s. If its own handler is running, the entry is erased once the
+* handler returns.
+*/
+void CEventLoop::Unwatch(SOCKET s)
+{
+#ifdef EVENT_LOOP_EPOLL
+   epoll_event ev; // ignored, but must not be NULL on old kernels
+   epoll_ctl(m_epoll,EPOLL_CTL_DEL,s,&ev);
+#endif
+   if(s == m_dispatching)
+   {
+      m_bDispatchRemoved = true;
+      return;
+   }
+   m_entries.erase(s);
+}
+
+/**
+* Waits up to timeout ms (-1 for ever) for registered sockets to become
+* ready and dispatches them. Connections with posted output are watched for
+* writability as well. Returns the number of sockets dispatched.
+* @param timeout Time to wait in ms
+*/
+int CEventLoop::RunOnce(int timeout) throw (CSocketException)
+{
+   if(m_entries.empty()) return 0;
+   for(unordered_map<SOCKET,CEntry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+   {
+      if(it->second.robot == NULL) continue;
+      int interest = EVENT_READ | (it->second.robot->GetPendingOutput() > 0 ? EVENT_WRITE : 0);
+      Watch(it->first,it->second,interest,false);
+   }
+
+#ifdef EVENT_LOOP_EPOLL
+   epoll_event events[EVENT_LOOP_MAX_EVENTS];
+   int n = epoll_wait(m_epoll,events,EVENT_LOOP_MAX_EVENTS,timeout);
+   if(n == -1)
+   {
+      int nret = WSAGetLastError();
+      if(nret == EINTR) return 0;
+      throw CSocketException(nret, "Network failure: RunOnce()");
+   }
+   for(int i = 0; i < n; i++)
+   {
+      int flags = 0;
+      if(events[i].events & EPOLLIN) flags |= EVENT_READ;
+      if(events[i].events & EPOLLOUT) flags |= EVENT_WRITE;
+      if(events[i].events & (EPOLLERR | EPOLLHUP)) flags |= EVENT_READ | EVENT_CLOSED;
+      Dispatch(events[i].data.fd,flags);
+   }
+   return n;
+#else
+   fd_set readSet,writeSet;
+   timeval tv;
+   SOCKET maxSocket = 0;
+   FD_ZERO(&readSet);
+   FD_ZERO(&writeSet);
+   for(unordered_map<SOCKET,CEntry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+   {
+      FD_SET(it->first,&readSet);
+      if(it->second.interest & EVENT_WRITE) FD_SET(it->first,&writeSet);
+      if(it->first > maxSocket) maxSocket = it->first;
+   }
+   tv.tv_sec = timeout / 1000;
+   tv.tv_usec = (timeout % 1000) * 1000;
+   int nret = select((int)maxSocket + 1,&readSet,&writeSet,NULL,timeout < 0 ? NULL : &tv);
+   if(nret == SOCKET_ERROR)
+   {
+      nret = WSAGetLastError();
+      if(nret == WSAEINTR) return 0;
+      throw CSocketException(nret, "Network failure: RunOnce()");
+   }
+
+   // Collect first: handlers may add and remove entries
+   vector<pair<SOCKET,int> > ready;
+   for(unordered_map<SOCKET,CEntry>::iterator it = m_entries.begin(); it != m_entries.end() && nret > 0; ++it)
+   {
+      int flags = 0;
+      if(FD_ISSET(it->first,&readSet)) flags |= EVENT_READ;
+      if(FD_ISSET(it->first,&writeSet)) flags |= EVENT_WRITE;
+      if(flags != 0) ready.push_back(make_pair(it->first,flags));
+   }
+   for(size_t i = 0; i < ready.size(); i++)
+      Dispatch(ready[i].first,ready[i].second);
+   return (int)ready.size();
+#endif
+}
+
+/**
+* Handles one ready socket: accepts every waiting client on a server, or
+* flushes posted output and calls the connection's handler. A connection
+* that has closed is reported once with EVENT_CLOSED and then dropped.
+*/
+void CEventLoop::Dispatch(SOCKET s,int events) throw (CSocketException)
+{
+   unordered_map<SOCKET,CEntry>::iterator it = m_entries.find(s);
+   if(it == m_entries.end()) return;
+   CEntry& entry = it->second; // element references survive rehashing
+   m_dispatching = s;
+   m_bDispatchRemoved = false;
+
+   try
+   {
+      if(entry.server != NULL)
+      {
+         CRobot* client;
+         while(!m_bDispatchRemoved && (client = entry.server->Accept()) != NULL)
+            entry.onAccept(client);
+      }
+      else
+      {
+         CRobot* robot = entry.robot;
+         if(events & EVENT_WRITE)
+         {
+            try
+            {
+               robot->Flush();
+            }
+            catch(CSocketException&)
+            {
+               events |= EVENT_CLOSED;
+            }
+         }
+         if(robot->IsPeerClosed()) events |= EVENT_CLOSED;
+         entry.onEvent(robot,events);
+         if(!m_bDispatchRemoved && (events & EVENT_CLOSED))
+            Unwatch(s);
+      }
+   }
+   catch(...)
+   {
+      m_dispatching = INVALID_SOCKET;
+      if(m_bDispatchRemoved) m_entries.erase(s);
+      throw;
+   }
+   m_dispatching = INVALID_SOCKET;
+   if(m_bDispatchRemoved) m_entries.erase(s);
+}
+
+/**
+* Dispatches until Stop() is called or nothing is left to watch.
+*/
+void CEventLoop::Run() throw (CSocketException)
+{
+   m_bStopping = false;
+   while(!m_bStopping && !m_entries.empty())
+      RunOnce(-1);
+}
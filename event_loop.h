@@ -0,0 +1,71 @@
+#ifndef _EVENT_LOOP_H_
+#define _EVENT_LOOP_H_
+
+#include <functional>
+#include <unordered_map>
+using namespace std;
+#include "robot.h"
+
+#define EVENT_LOOP_MAX_EVENTS  256 /// readiness events taken per wait
+
+namespace openutils
+{
+   /// What a connection is ready for, passed to its handler.
+   enum EventFlags
+   {
+      EVENT_READ = 1, /// data (or the end of the stream) can be read
+      EVENT_WRITE = 2, /// posted output was flushed
+      EVENT_CLOSED = 4 /// the connection failed or hung up
+   };
+
+   /// Called when a connection is ready; events is a mask of EventFlags.
+   typedef function<void(CRobot* robot,int events)> RobotHandler;
+   /// Called with every client a listening server accepts.
+   typedef function<void(CRobot* client)> AcceptHandler;
+
+   /**
+   * Drives many CRobot connections (and the servers accepting them) from
+   * one thread. Registered sockets are switched to non-blocking mode; the
+   * loop waits with epoll on Linux and select() elsewhere, flushes output
+   * queued with CRobot::Post() when the socket has room, and calls the
+   * handler when a connection is readable. Handlers read with
+   * ReadAvailable()/ReadLine(), write with Post(), and must Remove() a
+   * connection before deleting it.
+   */
+   class CEventLoop
+   {
+   private:
+      struct CEntry
+      {
+         CRobot* robot; /// connection, or NULL for a server
+         CServerSocket* server; /// listening server, or NULL
+         RobotHandler onEvent; /// connection handler
+         AcceptHandler onAccept; /// server handler
+         int interest; /// EVENT_READ / EVENT_WRITE currently watched
+      };
+
+      unordered_map<SOCKET,CEntry> m_entries; /// registered sockets
+      SOCKET m_epoll; /// epoll instance (Linux), unused with select()
+      bool m_bStopping; /// asks Run() to return
+      SOCKET m_dispatching; /// socket whose handler is running
+      bool m_bDispatchRemoved; /// that socket was removed by its own handler
+   public:
+      CEventLoop() throw (CSocketException); /// Creates an empty loop
+      ~CEventLoop(); /// Releases the loop; registered objects are left open
+      void Add(CRobot* robot,RobotHandler handler) throw (CSocketException); /// Watches a connection
+      void Add(CServerSocket* server,AcceptHandler handler) throw (CSocketException); /// Listens and watches for clients
+      void Remove(CRobot* robot); /// Stops watching a connection
+      void Remove(CServerSocket* server); /// Stops watching a server
+      int RunOnce(int timeout) throw (CSocketException); /// Waits up to timeout ms and dispatches, returns events handled
+      void Run() throw (CSocketException); /// Dispatches until Stop() or nothing is registered
+      void Stop() { m_bStopping = true; } /// Makes Run() return after the current dispatch
+      int GetCount() { return (int)m_entries.size(); } /// Returns the number of registered sockets
+      static const char* GetBackend(); /// Returns "epoll" or "select"
+   private:
+      void Watch(SOCKET s,CEntry& entry,int interest,bool added) throw (CSocketException); /// Updates the readiness interest
+      void Unwatch(SOCKET s); /// Removes a socket from the backend and the table
+      void Dispatch(SOCKET s,int events) throw (CSocketException); /// Handles one ready socket
+   };
+}
+
+#endif
@@ -0,0 +1,330 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include "job_file.h"
+#include "command_parser.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+using namespace openutils;
+
+static_assert(sizeof(int) == sizeof(int32_t),"command ends are handed out as int");
+static_assert(sizeof(CJobHeader) % 8 == 0 && sizeof(CJobStroke) % 8 == 0,"index entries stay 8-byte aligned");
+
+/// Pen-up travel between two joint positions: the joints move together.
+static double jointTravel(const JointWaypoint& a,const JointWaypoint& b)
+{
+   return fmax(fabs(a.j1 - b.j1),fabs(a.j2 - b.j2));
+}
+
+CJobCompiler::CJobCompiler()
+{
+   m_nArm = LEFT_ARM_SOLUTION;
+   m_dTolerance = DEFAULT_LINE_TOLERANCE;
+   m_bSpeed = false;
+   m_speed = MOTOR_SPEED_HIGH;
+   m_bColor = false;
+   m_r = m_g = m_b = 0;
+   m_nPrologue = 0;
+   m_nSkipped = 0;
+   m_dTravel = 0;
+}
+
+/**
+* Sets how far the traced path may stray from the drawing, both when
+* strokes are simplified and when segments are planned. Returns false,
+* keeping the previous tolerance, unless mm is positive.
+* @param mm Tolerance in mm
+*/
+bool CJobCompiler::SetTolerance(double mm)
+{
+   if(!(mm > 0)) return false;
+   m_dTolerance = mm;
+   return true;
+}
+
+void CJobCompiler::SetMotorSpeed(MotorSpeed speed)
+{
+   m_bSpeed = true;
+   m_speed = speed;
+}
+
+void CJobCompiler::SetPenColor(int r,int g,int b)
+{
+   m_bColor = true;
+   m_r = r;
+   m_g = g;
+   m_b = b;
+}
+
+void CJobCompiler::Emit(CCommandEncoder& encoder)
+{
+   m_data.append(encoder.GetData(),encoder.GetLength());
+   m_ends.push_back((int32_t)m_data.size());
+   encoder.Reset();
+}
+
+/**
+* Compiles a drawing, replacing any job compiled before. Each stroke is
+* simplified to within the tolerance, the strokes are ordered from the
+* home position, and every stroke is encoded as a move to its start,
+* PEN_DOWN, the joint waypoints of its segments and PEN_UP. Returns the
+* number of strokes compiled.
+* @param strokes Polylines to draw, in mm
+*/
+int CJobCompiler::Compile(const vector<Stroke>& strokes)
+{
+   m_data.clear();
+   m_ends.clear();
+   m_strokes.clear();
+   m_nSkipped = 0;
+   m_dTravel = 0;
+
+   char buffer[MAX_COMMAND_LINE];
+   CCommandEncoder encoder(buffer,sizeof(buffer));
+   Emit(encoder.PenUp());
+   if(m_bSpeed) Emit(encoder.SetMotorSpeed(m_speed));
+   if(m_bColor) Emit(encoder.PenColor(m_r,m_g,m_b));
+   m_nPrologue = (uint32_t)m_ends.size();
+
+   vector<Stroke> paths(strokes);
+   for(size_t k = 0; k < paths.size(); k++)
+      simplifyPath(&paths[k],m_dTolerance);
+   JointWaypoint at = { 0,0 };
+   vector<StrokeOrder> order;
+   orderStrokes(paths,m_nArm,at,&order);
+
+   vector<PathPoint> path;
+   vector<JointWaypoint> joints,waypoints;
+   vector<int> arms;
+   for(size_t k = 0; k < order.size(); k++)
+   {
+      path = paths[order[k].stroke];
+      if(order[k].reversed) reverse(path.begin(),path.end());
+      if(planArmConfigurations(path,&at,DEFAULT_FLIP_PENALTY,&joints,&arms) < 0)
+      {
+         m_nSkipped++;
+         continue;
+      }
+
+      CJobStroke entry;
+      entry.firstCommand = (uint32_t)m_ends.size();
+      entry.source = (uint32_t)order[k].stroke;
+      entry.flags = order[k].reversed ? JOB_STROKE_REVERSED : 0;
+      entry.j1 = joints[0].j1;
+      entry.j2 = joints[0].j2;
+      m_dTravel += jointTravel(at,joints[0]);
+      Emit(encoder.RotateJoint(joints[0].j1,joints[0].j2));
+      Emit(encoder.PenDown());
+
+      for(size_t i = 0; i + 1 < path.size(); i++)
+      {
+         int arm = arms[i+1];
+         bool lift = false;
+         if(arms[i] != arm)
+         {
+            // Change sides at point i with the pen up
+            JointWaypoint flipped;
+            entry.flags |= JOB_STROKE_GAPS;
+            lift = scaraIK(path[i].x,path[i].y,&flipped.j1,&flipped.j2,arm) != 0;
+            if(!lift)
+            {
+               Emit(encoder.PenUp());
+               Emit(encoder.RotateJoint(flipped.j1,flipped.j2));
+               Emit(encoder.PenDown());
+            }
+         }
+         waypoints.clear();
+         if(lift || planLinearMove(path[i].x,path[i].y,path[i+1].x,path[i+1].y,arm,m_dTolerance,&waypoints) != 0)
+         {
+            // No straight path with this arm: cross the segment with the pen up
+            Emit(encoder.PenUp());
+            Emit(encoder.RotateJoint(joints[i+1].j1,joints[i+1].j2));
+            Emit(encoder.PenDown());
+            entry.flags |= JOB_STROKE_GAPS;
+            continue;
+         }
+         for(size_t w = 0; w < waypoints.size(); w++)
+            Emit(encoder.RotateJoint(waypoints[w].j1,waypoints[w].j2));
+      }
+
+      Emit(encoder.PenUp());
+      entry.commandCount = (uint32_t)m_ends.size() - entry.firstCommand;
+      m_strokes.push_back(entry);
+      at = joints.back();
+   }
+   return (int)m_strokes.size();
+}
+
+/**
+* Writes the compiled job in the layout described at CJobHeader.
+* @param path File to create or replace
+*/
+bool CJobCompiler::Write(const char* path)
+{
+   CJobHeader header;
+   memset(&header,0,sizeof(header));
+   memcpy(header.magic,JOB_MAGIC,sizeof(header.magic));
+   header.version = JOB_VERSION;
+   header.headerSize = sizeof(CJobHeader);
+   header.strokeCount = (uint32_t)m_strokes.size();
+   header.commandCount = (uint32_t)m_ends.size();
+   header.prologueCount = m_nPrologue;
+   header.skipped = m_nSkipped;
+   header.strokesOffset = sizeof(CJobHeader);
+   header.endsOffset = header.strokesOffset + m_strokes.size() * sizeof(CJobStroke);
+   header.dataOffset = (header.endsOffset + m_ends.size() * sizeof(int32_t) + 7) & ~(uint64_t)7;
+   header.dataSize = m_data.size();
+   header.travel = m_dTravel;
+
+   FILE* file = fopen(path,"wb");
+   if(file == NULL) return false;
+   static const char padding[8] = { 0 };
+   size_t pad = (size_t)(header.dataOffset - header.endsOffset - m_ends.size() * sizeof(int32_t));
+   bool ok = fwrite(&header,sizeof(header),1,file) == 1
+          && fwrite(m_strokes.data(),sizeof(CJobStroke),m_strokes.size(),file) == m_strokes.size()
+          && fwrite(m_ends.data(),sizeof(int32_t),m_ends.size(),file) == m_ends.size()
+          && fwrite(padding,1,pad,file) == pad
+          && fwrite(m_data.data(),1,m_data.size(),file) == m_data.size();
+   return fclose(file) == 0 && ok;
+}
+
+CJobFile::CJobFile()
+{
+   m_base = NULL;
+   m_nSize = 0;
+#ifdef _WIN32
+   m_file = INVALID_HANDLE_VALUE;
+   m_mapping = NULL;
+#else
+   m_fd = -1;
+#endif
+   m_header = NULL;
+   m_strokes = NULL;
+   m_ends = NULL;
+   m_data = NULL;
+}
+
+CJobFile::~CJobFile()
+{
+   Close();
+}
+
+/**
+* Maps a job file read-only, closing any job mapped before, and checks
+* that it can be played. Returns false if the file cannot be mapped or is
+* not a valid job.
+* @param path Job file written by CJobCompiler::Write()
+*/
+bool CJobFile::Open(const char* path)
+{
+   Close();
+#ifdef _WIN32
+   m_file = CreateFileA(path,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+   if(m_file == INVALID_HANDLE_VALUE) return false;
+   LARGE_INTEGER size;
+   if(!GetFileSizeEx(m_file,&size) || size.QuadPart < (LONGLONG)sizeof(CJobHeader))
+   {
+      Close();
+      return false;
+   }
+   m_nSize = (size_t)size.QuadPart;
+   m_mapping = CreateFileMappingA(m_file,NULL,PAGE_READONLY,0,0,NULL);
+   if(m_mapping != NULL) m_base = (const char*)MapViewOfFile(m_mapping,FILE_MAP_READ,0,0,0);
+#else
+   m_fd = open(path,O_RDONLY);
+   if(m_fd < 0) return false;
+   struct stat st;
+   if(fstat(m_fd,&st) != 0 || st.st_size < (off_t)sizeof(CJobHeader))
+   {
+      Close();
+      return false;
+   }
+   m_nSize = (size_t)st.st_size;
+   void* base = mmap(NULL,m_nSize,PROT_READ,MAP_SHARED,m_fd,0);
+   if(base != MAP_FAILED)
+   {
+      m_base = (const char*)base;
+#ifdef MADV_SEQUENTIAL
+      madvise(base,m_nSize,MADV_SEQUENTIAL);
+#endif
+   }
+#endif
+   if(m_base == NULL || !Validate())
+   {
+      Close();
+      return false;
+   }
+   return true;
+}
+
+/**
+* Checks the header against the file size and walks the command ends
+* once: increasing, inside the data, each command ending in '\n', and
+* every stroke inside the commands after the prologue, starting where the
+* previous stroke ends, since CJobPlayer::Play() sends a run of strokes as
+* one slice of commands.
+*/
+bool CJobFile::Validate()
+{
+   const CJobHeader* header = (const CJobHeader*)m_base;
+   if(memcmp(header->magic,JOB_MAGIC,sizeof(header->magic)) != 0) return false;
+   if(header->version != JOB_VERSION || header->headerSize != sizeof(CJobHeader)) return false;
+   if(header->strokesOffset % 8 != 0 || header->endsOffset % sizeof(int32_t) != 0) return false;
+   if(header->dataSize > INT_MAX || header->commandCount > INT_MAX || header->strokeCount > INT_MAX) return false;
+   if(header->strokesOffset + (uint64_t)header->strokeCount * sizeof(CJobStroke) > m_nSize) return false;
+   if(header->endsOffset + (uint64_t)header->commandCount * sizeof(int32_t) > m_nSize) return false;
+   if(header->dataOffset > m_nSize || header->dataSize > m_nSize - header->dataOffset) return false;
+   if(header->prologueCount > header->commandCount) return false;
+
+   const CJobStroke* strokes = (const CJobStroke*)(m_base + header->strokesOffset);
+   const int* ends = (const int*)(m_base + header->endsOffset);
+   const char* data = m_base + header->dataOffset;
+   int previous = 0;
+   for(uint32_t i = 0; i < header->commandCount; i++)
+   {
+      if(ends[i] <= previous || ends[i] > (int)header->dataSize || data[ends[i] - 1] != '\n') return false;
+      previous = ends[i];
+   }
+   if(previous != (int)header->dataSize) return false;
+   for(uint32_t k = 0; k < header->strokeCount; k++)
+   {
+      if(strokes[k].firstCommand < header->prologueCount) return false;
+      if((uint64_t)strokes[k].firstCommand + strokes[k].commandCount > header->commandCount) return false;
+      if(k > 0 && strokes[k].firstCommand != strokes[k-1].firstCommand + strokes[k-1].commandCount) return false;
+   }
+
+   m_header = header;
+   m_strokes = strokes;
+   m_ends = ends;
+   m_data = data;
+   return true;
+}
+
+void CJobFile::Close()
+{
+#ifdef _WIN32
+   if(m_base != NULL) UnmapViewOfFile(m_base);
+   if(m_mapping != NULL) CloseHandle(m_mapping);
+   if(m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+   m_file = INVALID_HANDLE_VALUE;
+   m_mapping = NULL;
+#else
+   if(m_base != NULL) munmap((void*)m_base,m_nSize);
+   if(m_fd >= 0) close(m_fd);
+   m_fd = -1;
+#endif
+   m_base = NULL;
+   m_nSize = 0;
+   m_header = NULL;
+   m_strokes = NULL;
+   m_ends = NULL;
+   m_data = NULL;
+}
@@ -0,0 +1,141 @@
+#ifndef _JOB_FILE_H_
+#define _JOB_FILE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+#include "command_encoder.h"
+#include "scara_motion.h"
+
+#define JOB_MAGIC           "SCARAJOB" /// first 8 bytes of a job file
+#define JOB_VERSION         1          /// format written by CJobCompiler
+#define JOB_STROKE_REVERSED 0x01       /// the stroke is drawn last point to first
+#define JOB_STROKE_GAPS     0x02       /// the pen was lifted inside the stroke, see CJobCompiler
+
+namespace openutils
+{
+   /**
+   * Start of a compiled job file. The file is laid out as
+   *
+   *    CJobHeader
+   *    CJobStroke[strokeCount]       at strokesOffset
+   *    int32_t[commandCount]         at endsOffset: offset just past each command's '\n'
+   *    char[dataSize]                at dataOffset: the commands, back to back
+   *
+   * in the byte order of the machine that compiled it. Command i spans
+   * [i == 0 ? 0 : ends[i-1], ends[i]) of the data, the layout
+   * CRobot::SendCommands() takes. The first prologueCount commands raise
+   * the pen and set speed and colour; every stroke after them starts and
+   * ends with the pen up, so playback can start at any stroke.
+   */
+   struct CJobHeader
+   {
+      char magic[8]; /// JOB_MAGIC, not NUL-terminated
+      uint32_t version; /// JOB_VERSION
+      uint32_t headerSize; /// sizeof(CJobHeader)
+      uint32_t strokeCount; /// entries in the stroke index
+      uint32_t commandCount; /// entries in the command ends
+      uint32_t prologueCount; /// commands before the first stroke
+      uint32_t skipped; /// input strokes left out as unreachable
+      uint64_t strokesOffset; /// file offset of the stroke index
+      uint64_t endsOffset; /// file offset of the command ends
+      uint64_t dataOffset; /// file offset of the command bytes
+      uint64_t dataSize; /// number of command bytes
+      double travel; /// pen-up joint travel between strokes in degrees
+   };
+
+   /// One stroke of a compiled job.
+   struct CJobStroke
+   {
+      uint32_t firstCommand; /// index of the stroke's first command
+      uint32_t commandCount; /// commands from the move to its start to the final PEN_UP
+      uint32_t source; /// index of the stroke in the compiled drawing
+      uint32_t flags; /// JOB_STROKE_REVERSED, JOB_STROKE_GAPS
+      double j1,j2; /// joint angles at the stroke's start in degrees
+   };
+
+   /**
+   * Turns a drawing into a job file: orders the strokes for the least
+   * pen-up travel (orderStrokes), chooses the arm at every point
+   * (planArmConfigurations), plans each segment as a straight line
+   * (planLinearMove) and encodes the commands, all once. Strokes that are
+   * not reachable with either arm are left out. Where the arm has to
+   * change sides inside a stroke, the pen is lifted for the flip; a
+   * segment that cannot be traced straight with one arm is crossed with
+   * the pen up. Such strokes are marked JOB_STROKE_GAPS.
+   */
+   class CJobCompiler
+   {
+   private:
+      int m_nArm; /// preferred arm solution
+      double m_dTolerance; /// mm the traced path may stray from the drawing
+      bool m_bSpeed; /// the prologue sets m_speed
+      MotorSpeed m_speed; /// MOTOR_SPEED of the job
+      bool m_bColor; /// the prologue sets m_r/m_g/m_b
+      int m_r,m_g,m_b; /// pen colour of the job
+      string m_data; /// encoded commands
+      vector<int32_t> m_ends; /// offset just past each command in m_data
+      vector<CJobStroke> m_strokes; /// stroke index
+      uint32_t m_nPrologue; /// commands before the first stroke
+      uint32_t m_nSkipped; /// strokes left out
+      double m_dTravel; /// pen-up joint travel
+   public:
+      CJobCompiler(); /// Left arm, DEFAULT_LINE_TOLERANCE, no speed or colour
+      void SetArm(int arm) { m_nArm = arm; } /// Sets the preferred arm solution
+      bool SetTolerance(double mm); /// Sets how far the path may stray from the drawing, false unless positive
+      void SetMotorSpeed(MotorSpeed speed); /// Adds MOTOR_SPEED to the prologue
+      void SetPenColor(int r,int g,int b); /// Adds PEN_COLOR to the prologue
+      int Compile(const vector<Stroke>& strokes); /// Compiles a drawing, returns the strokes kept
+      bool Write(const char* path); /// Writes the compiled job, false on failure
+      int GetStrokeCount() { return (int)m_strokes.size(); } /// Returns the strokes compiled
+      int GetCommandCount() { return (int)m_ends.size(); } /// Returns the commands encoded
+      int GetSkippedCount() { return (int)m_nSkipped; } /// Returns the strokes left out
+      int GetLength() { return (int)m_data.size(); } /// Returns the command bytes
+      double GetTravel() { return m_dTravel; } /// Returns the pen-up joint travel in degrees
+   private:
+      void Emit(CCommandEncoder& encoder); /// Appends the encoded command and resets the encoder
+   };
+
+   /**
+   * A job file mapped read-only into memory. Open() checks the header and
+   * that the index and command ends are consistent with the data, once;
+   * after that the commands are handed to CRobot::SendCommands() straight
+   * from the mapping.
+   */
+   class CJobFile
+   {
+   private:
+      const char* m_base; /// start of the mapping, NULL if closed
+      size_t m_nSize; /// bytes mapped
+#ifdef _WIN32
+      void* m_file; /// file HANDLE
+      void* m_mapping; /// file mapping HANDLE
+#else
+      int m_fd; /// file descriptor
+#endif
+      const CJobHeader* m_header; /// header inside the mapping
+      const CJobStroke* m_strokes; /// stroke index inside the mapping
+      const int* m_ends; /// command ends inside the mapping
+      const char* m_data; /// command bytes inside the mapping
+   public:
+      CJobFile(); /// Nothing mapped
+      ~CJobFile(); /// Unmaps the file
+      bool Open(const char* path); /// Maps and validates a job file
+      void Close(); /// Unmaps the file
+      bool IsOpen() const { return m_base != NULL; } /// True while a job is mapped
+      const CJobHeader& GetHeader() const { return *m_header; } /// Returns the header
+      int GetStrokeCount() const { return (int)m_header->strokeCount; } /// Returns the strokes in the job
+      int GetCommandCount() const { return (int)m_header->commandCount; } /// Returns the commands in the job
+      int GetPrologueCount() const { return (int)m_header->prologueCount; } /// Returns the commands before the first stroke
+      const CJobStroke& GetStroke(int index) const { return m_strokes[index]; } /// Returns a stroke's index entry
+      const char* GetData() const { return m_data; } /// Returns the command bytes
+      const int* GetEnds() const { return m_ends; } /// Returns the offset just past each command
+   private:
+      bool Validate(); /// Checks the mapped header, index and ends
+      CJobFile(const CJobFile&); /// not copyable
+      void operator = (const CJobFile&);
+   };
+}
+
+#endif
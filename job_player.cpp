@@ -0,0 +1,53 @@
+#include "job_player.h"
+using namespace openutils;
+
+/**
+* @param robot Connected robot to write to
+* @param job Mapped job, kept open while playing
+*/
+CJobPlayer::CJobPlayer(CRobot* robot,const CJobFile* job)
+{
+   m_robot = robot;
+   m_job = job;
+   m_nNext = 0;
+   m_bPrologue = true;
+}
+
+/**
+* Makes the next Play() start at stroke, sending the prologue first.
+* @param stroke Index into the job's stroke index, clamped to the job
+*/
+void CJobPlayer::Seek(int stroke)
+{
+   int count = m_job->GetStrokeCount();
+   m_nNext = stroke < 0 ? 0 : stroke > count ? count : stroke;
+   m_bPrologue = true;
+}
+
+/**
+* Sends the next strokes, preceded by the prologue after construction or
+* Seek(). Strokes are stored back to back, so any run of them is one
+* slice of the mapping and one SendCommands() call. GetNext() advances
+* only once a run has been written; after an exception it still names
+* the first stroke of the run that failed.
+* @param strokes Strokes to send, -1 for the rest of the job
+*/
+int CJobPlayer::Play(int strokes) throw (CSocketException)
+{
+   const char* data = m_job->GetData();
+   const int* ends = m_job->GetEnds();
+   int count = m_job->GetStrokeCount() - m_nNext;
+   if(strokes >= 0 && strokes < count) count = strokes;
+
+   if(m_bPrologue)
+   {
+      m_robot->SendCommands(data,ends,0,m_job->GetPrologueCount());
+      m_bPrologue = false;
+   }
+   if(count <= 0) return 0;
+   const CJobStroke& first = m_job->GetStroke(m_nNext);
+   const CJobStroke& last = m_job->GetStroke(m_nNext + count - 1);
+   m_robot->SendCommands(data,ends,first.firstCommand,last.firstCommand + last.commandCount);
+   m_nNext += count;
+   return count;
+}
@@ -0,0 +1,33 @@
+#ifndef _JOB_PLAYER_H_
+#define _JOB_PLAYER_H_
+
+#include "robot.h"
+#include "job_file.h"
+
+namespace openutils
+{
+   /**
+   * Streams a mapped job to a CRobot. Each Play() hands a contiguous run
+   * of strokes to CRobot::SendCommands() straight from the mapping, so no
+   * command is parsed, formatted or copied on the way; the robot's pacing
+   * and resilient mode apply as usual. The prologue (pen up, speed,
+   * colour) goes out before the first stroke played and again after every
+   * Seek(), so a job interrupted at any stroke can be resumed from it.
+   */
+   class CJobPlayer
+   {
+   private:
+      CRobot* m_robot; /// connection written to
+      const CJobFile* m_job; /// mapped job
+      int m_nNext; /// next stroke to send
+      bool m_bPrologue; /// the prologue goes out before m_nNext
+   public:
+      CJobPlayer(CRobot* robot,const CJobFile* job); /// Starts at the first stroke
+      void Seek(int stroke); /// Continues at stroke, after the prologue
+      int Play(int strokes = -1) throw (CSocketException); /// Sends up to strokes strokes (-1 for all), returns strokes sent
+      int GetNext() { return m_nNext; } /// Returns the next stroke to send
+      bool IsDone() { return m_nNext >= m_job->GetStrokeCount(); } /// True once every stroke was sent
+   };
+}
+
+#endif
@@ -47,19 +47,17 @@
 #include <stdio.h>  // <list of functions used>
 #include <math.h>   // <list of functions used>
 #include "robot.h"  // <list of functions used> // NOTE: DO NOT REMOVE.
+#include "command_encoder.h" // CCommandEncoder
+#include "scara_kinematics.h" // scaraFK, scaraIK, arm constants
+#include "scara_motion.h" // planLinearMove
 #include <windows.h> // For console colors
 #include <string>   // For string operations
 #include <iostream> // For improved input/output
+#include <chrono>   // For polling queued moves
+#include <future>   // For completion of queued moves
 
 /*|CONSTANTS|------------------------------------------------------------------*/
-#define L1                    350.0
-#define L2                    250.0
-#define MAX_ABS_THETA1_DEG    150.0
-#define MAX_ABS_THETA2_DEG    170.0
 #define MAX_STRING            256
-#define PI                    3.14159265358979323846
-#define LEFT_ARM_SOLUTION     0
-#define RIGHT_ARM_SOLUTION    1
 #define ESC                   27
 
 // Console color definitions
@@ -76,14 +74,16 @@
 /*|Globals|--------------------------------------------------------------------*/
 CRobot robot;
 bool ArmType = LEFT_ARM_SOLUTION;
-char commandString[MAX_STRING];
 HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE); // Handle to console for color manipulation
+std::future<int> lastMove; // Completion of the last move handed to the sender thread
 
 /*|Function Prototypes|--------------------------------------------------------*/
-int scaraFK (double, double, double*, double*);
-int scaraIK (double, double, double*, double*, int);
 void moveScaraIK(void);
 void moveScaraFK(void);
+void moveScaraLinear(void);
+bool checkLastMove(bool wait);
+void queueMove(CCommandBatch& batch, const char* queued);
+bool sendCommand(const char* command);
 
 // UI Helper functions
 void setConsoleColor(int color);
@@ -97,7 +97,7 @@ void printDivider();
 void printCoordinates(double x, double y);
 void printAngles(double j1, double j2);
 void clearScreen();
-void promptPen();
+void promptPen(CCommandBatch& batch);
 void displayWelcomeScreen();
 void displayArmConfigurations(double j1, double j2);
 
@@ -133,9 +133,13 @@ int main(){
       return 0;
    }
    printSuccess("Connected to simulator successfully!");
+
+   // Transmit on a background thread so the menu stays responsive while the robot moves
+   robot.StartAsync();
    
    // Main program loop
    while (1) {
+      checkLastMove(false);
       printDivider();
       printTitle("SCARA ROBOT CONTROL INTERFACE");
       printDivider();
@@ -144,14 +148,15 @@ int main(){
       setConsoleColor(COLOR_INFO);
       printf("\n  [1] Forward Kinematics (Angles to Coordinates)");
       printf("\n  [2] Inverse Kinematics (Coordinates to Angles)");
-      printf("\n  [3] Clear Trace");
-      printf("\n  [4] Home Position");
-      printf("\n  [5] Exit");
+      printf("\n  [3] Straight Line Move");
+      printf("\n  [4] Clear Trace");
+      printf("\n  [5] Home Position");
+      printf("\n  [6] Exit");
       printf("\n\n");
       
       // Get user choice
       int choice = 0;
-      printPrompt("Enter your choice (1-5): ");
+      printPrompt("Enter your choice (1-6): ");
       setConsoleColor(COLOR_INPUT);
       scanf("%d", &choice);
       getchar(); // Clear input buffer
@@ -164,23 +169,25 @@ int main(){
             moveScaraIK();
             break;
          case 3:
-            printInfo("Clearing trace...");
-            robot.Send("CLEAR_TRACE\n");
-            printSuccess("Trace cleared!");
+            moveScaraLinear();
             break;
          case 4:
-            printInfo("Moving to home position...");
-            robot.Send("HOME\n");
-            printSuccess("Robot is at home position!");
+            printInfo("Clearing trace...");
+            if (sendCommand("CLEAR_TRACE\n")) printSuccess("Trace cleared!");
             break;
          case 5:
+            printInfo("Moving to home position...");
+            if (sendCommand("HOME\n")) printSuccess("Robot is at home position!");
+            break;
+         case 6:
             printInfo("Shutting down...");
-            robot.Send("END\n");
+            checkLastMove(true);
+            sendCommand("END\n");
             robot.Close();
             printSuccess("Goodbye!");
             return 0;
          default:
-            printError("Invalid choice! Please enter a number between 1 and 5.");
+            printError("Invalid choice! Please enter a number between 1 and 6.");
             break;
       }
    }
@@ -191,35 +198,13 @@ int main(){
    return 0;
 }
 
-/**
- * @brief This function will calculate the x,y coordinates given two joint angles.
- *
- * @param _j1 Angle of joint 1 in degrees.
- * @param _j2 Angle of joint 2 in degrees.
- * @param _x The tool position along the x-axis. Pointer
- * @param _y The tool position along the y-axis. Pointer
- *
- * @return inRange (0) in range, (-1) out of range
- */
-int scaraFK (double _j1, double _j2, double* _x, double* _y) {
-   if (abs(_j1) > MAX_ABS_THETA1_DEG) return -1;
-   if (abs(_j2) > MAX_ABS_THETA2_DEG) return -2;
-
-   _j1 *= PI/180.0;
-   _j2 *= PI/180.0;
-   *_x = L1*cos(_j1)+L2*cos(_j1+_j2);
-   *_y = L1*sin(_j1)+L2*sin(_j1+_j2);
-
-   return 0;
-}
-
-void promptPen() {
+void promptPen(CCommandBatch& batch) {
    char pen;
    printPrompt("Draw line? (Y/N): ");
    setConsoleColor(COLOR_INPUT);
    scanf("%c", &pen);
    getchar();
-   robot.Send(pen=='y' || pen == 'Y' ? "PEN_DOWN\n" : "PEN_UP\n");
+   batch.Add(pen=='y' || pen == 'Y' ? "PEN_DOWN\n" : "PEN_UP\n");
 
    if(pen=='y' || pen == 'Y') {
       printSuccess("Pen down - drawing enabled");
@@ -228,47 +213,6 @@ void promptPen() {
    }
 }
 
-/**
-* @brief Calculate two joint angles given the x,y coordinates.
-*
-* @param _x - The tool position along the x-axis.
-* @param _y - The tool position along the y-axis.
-* @param _j1 - Angle of joint 1 in degrees. Pointer
-* @param _j2 - Angle of joint 2 in degrees. Pointer
-* @param arm - Selects which solution to try.
-*
-* @return - (0) in range, (-1) out of range
-*/
-int scaraIK (double _x, double _y, double* _j1, double* _j2, int arm) {
-
-   const double L = sqrt(_x*_x + _y*_y);
-   const double Min = sqrt(((L1*L1) + (L2*L2)) - (2 * L1 * L2 * cos(0.174532925)));
-
-   if ( L > L1 + L2 ) return -1;
-   if ( L < Min ) return -2;
-
-   // Calculate joint angles
-   const double beta = atan2(_y,_x);
-   const double alpha = acos(((L2*L2) - (L*L) - (L1*L1)) / (-2*L*L1));
-
-   *_j1 = beta + (arm  == RIGHT_ARM_SOLUTION ? alpha : -alpha);
-   *_j2 = atan2(_y - (L1 * sin(*_j1)), _x - (L1 * cos(*_j1))) - *_j1;
-
-   // Convert to degrees
-   *_j1 *= 180/PI;
-   *_j2 *= 180/PI;
-
-   if (*_j2 < -MAX_ABS_THETA2_DEG) *_j2 += 360;
-   if (*_j2 > MAX_ABS_THETA2_DEG) *_j2 -= 360;
-   if (*_j1 < -MAX_ABS_THETA1_DEG) *_j1 += 360;
-   if (*_j1 > MAX_ABS_THETA1_DEG) *_j1 -= 360;
-
-   if (fabs(*_j1) > MAX_ABS_THETA1_DEG) return -1;
-   if (fabs(*_j2) > MAX_ABS_THETA2_DEG) return -1;
-
-   return 0;
-}
-
 /**
  *@brief function will ask the user for SCARA joint variables in degrees. Then ask the user for the pen position and display the X,Y position.
 *
@@ -307,8 +251,8 @@ void moveScaraIK(void) {
          printError("Coordinates are out of reach for both arm configurations!");
          setConsoleColor(COLOR_INFO);
          printf("  ► Target coordinates: (%.2lf, %.2lf)\n", X, Y);
-         printf("  ► Max range: %.2lf mm\n", L1+L2);
-         printf("  ► Min range: %.2lf mm\n", L1-L2);
+         printf("  ► Max range: %.2lf mm\n", Lab07Arm::MAX_REACH);
+         printf("  ► Min range: %.2lf mm\n", Lab07Arm::MIN_REACH);
          continue;
       }
 
@@ -370,14 +314,16 @@ void moveScaraIK(void) {
    } while (1);
 
    // Ask about pen
-   promptPen();
-
-   // Send command to robot
-   sprintf(&commandString[0], "ROTATE_JOINT ANG1 %.2lf ANG2 %.2lf\n", J1, J2);
+   CCommandBatch batch;
+   promptPen(batch);
+
+   // Send pen, move and pen-up commands to robot in one batch
+   char command[MAX_STRING];
+   CCommandEncoder encoder(command, MAX_STRING);
+   encoder.RotateJoint(J1, J2).PenUp();
+   batch.Add(encoder.GetData(), encoder.GetLength());
    printInfo("Sending command to robot...");
-   robot.Send(commandString);
-   printSuccess("Robot moved successfully!");
-   robot.Send("PEN_UP\n");
+   queueMove(batch, "Move queued!");
 }
 
 /**
@@ -412,13 +358,13 @@ void moveScaraFK(void) {
          case (-1):
             printError("J1 is out of bounds!");
             setConsoleColor(COLOR_INFO);
-            printf("Range for J1: ±%.2lf°\n", MAX_ABS_THETA1_DEG);
+            printf("Range for J1: ±%.2lf°\n", Lab07Arm::MAX_THETA1_DEG);
             continue;
          break;
          case (-2):
             printError("J2 is out of bounds!");
             setConsoleColor(COLOR_INFO);
-            printf("Range for J2: ±%.2lf°\n", MAX_ABS_THETA2_DEG);
+            printf("Range for J2: ±%.2lf°\n", Lab07Arm::MAX_THETA2_DEG);
             continue;
          break;
       }
@@ -430,14 +376,122 @@ void moveScaraFK(void) {
    printCoordinates(X, Y);
 
    // Ask about pen
-   promptPen();
-
-   // Send command to robot
-   sprintf(&commandString[0], "ROTATE_JOINT ANG1 %.2lf ANG2 %.2lf\n", J1, J2);
+   CCommandBatch batch;
+   promptPen(batch);
+
+   // Send pen, move and pen-up commands to robot in one batch
+   char command[MAX_STRING];
+   CCommandEncoder encoder(command, MAX_STRING);
+   encoder.RotateJoint(J1, J2).PenUp();
+   batch.Add(encoder.GetData(), encoder.GetLength());
    printInfo("Sending command to robot...");
-   robot.Send(commandString);
-   printSuccess("Robot moved successfully!");
-   robot.Send("PEN_UP\n");
+   queueMove(batch, "Move queued!");
+}
+
+/**
+ *@brief function will ask the user for the start and end of a line, move to the start with the pen up,
+ * then trace the line with as few joint moves as keep the arm within DEFAULT_LINE_TOLERANCE of it.
+*
+* @param void
+*
+* @return void
+*/
+
+void moveScaraLinear(void) {
+   double X0, Y0, X1, Y1;
+   std::vector<JointWaypoint> waypoints;
+
+   // Display linear mode header
+   printDivider();
+   printSubtitle("STRAIGHT LINE MODE");
+   printInfo("Trace a straight line between two coordinates");
+   printDivider();
+
+   printPrompt("Input the start coordinates (X, Y): ");
+   setConsoleColor(COLOR_INPUT);
+   scanf("%lf, %lf", &X0, &Y0);
+   getchar();
+   printPrompt("Input the end coordinates (X, Y): ");
+   setConsoleColor(COLOR_INPUT);
+   scanf("%lf, %lf", &X1, &Y1);
+   getchar();
+
+   // Keep the current arm configuration for the whole line
+   waypoints.push_back(JointWaypoint());
+   int error = scaraIK(X0, Y0, &waypoints[0].j1, &waypoints[0].j2, ArmType);
+   if (!error) error = planLinearMove(X0, Y0, X1, Y1, ArmType, DEFAULT_LINE_TOLERANCE, &waypoints);
+   if (error) {
+      printError("The line leaves the reach of the current arm configuration!");
+      return;
+   }
+
+   // Move to the start with the pen up, then trace the line
+   char command[MAX_STRING];
+   CCommandEncoder encoder(command, MAX_STRING);
+   CCommandBatch batch;
+   batch.Add("PEN_UP\n");
+   for (size_t i = 0; i < waypoints.size(); i++) {
+      encoder.Reset();
+      encoder.RotateJoint(waypoints[i].j1, waypoints[i].j2);
+      batch.Add(encoder.GetData(), encoder.GetLength());
+      if (i == 0) promptPen(batch);
+   }
+   batch.Add("PEN_UP\n");
+
+   setConsoleColor(COLOR_INFO);
+   printf("  ► Line split into %d joint moves\n", (int)waypoints.size() - 1);
+   printInfo("Sending commands to robot...");
+   queueMove(batch, "Line queued!");
+}
+
+/**
+ * @brief Reports a failure of the last queued move, once it has been written or has failed
+ * @param wait Wait for the sender thread instead of returning while the move is still queued
+ * @return false if the move could not be sent to the robot
+ */
+bool checkLastMove(bool wait) {
+   if (!lastMove.valid()) return true;
+   if (!wait && lastMove.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return true;
+   try {
+      lastMove.get();
+      return true;
+   } catch (CSocketException& e) {
+      printError("The last move did not reach the robot!");
+      setConsoleColor(COLOR_INFO);
+      printf("  %s\n", e.GetMessage());
+      return false;
+   }
+}
+
+/**
+ * @brief Hands a batch to the sender thread, unless the previous move failed
+ * @param batch Commands of the move
+ * @param queued Message shown once the move is queued
+ */
+void queueMove(CCommandBatch& batch, const char* queued) {
+   if (!checkLastMove(false)) {
+      printError("Connection to the simulator lost, move not sent!");
+      return;
+   }
+   lastMove = robot.Enqueue(batch);
+   printSuccess(queued);
+}
+
+/**
+ * @brief Sends one command behind any queued moves and waits until it is written
+ * @param command Command text
+ * @return false if it could not be sent to the robot
+ */
+bool sendCommand(const char* command) {
+   try {
+      robot.Send(command);
+      return true;
+   } catch (CSocketException& e) {
+      printError("The command did not reach the robot!");
+      setConsoleColor(COLOR_INFO);
+      printf("  %s\n", e.GetMessage());
+      return false;
+   }
 }
 
 // UI Helper Functions Implementation
@@ -577,10 +631,10 @@ void displayWelcomeScreen() {
    printf("  The simulator allows controlling joint angles to move to desired (x, y) coordinates.\n\n");
 
    setConsoleColor(COLOR_INFO);
-   printf("  ► Arm Length 1 (L1): %.1f mm\n", L1);
-   printf("  ► Arm Length 2 (L2): %.1f mm\n", L2);
-   printf("  ► Max J1 Angle: ±%.1f degrees\n", MAX_ABS_THETA1_DEG);
-   printf("  ► Max J2 Angle: ±%.1f degrees\n\n", MAX_ABS_THETA2_DEG);
+   printf("  ► Arm Length 1 (L1): %.1f mm\n", Lab07Arm::LINK1);
+   printf("  ► Arm Length 2 (L2): %.1f mm\n", Lab07Arm::LINK2);
+   printf("  ► Max J1 Angle: ±%.1f degrees\n", Lab07Arm::MAX_THETA1_DEG);
+   printf("  ► Max J2 Angle: ±%.1f degrees\n\n", Lab07Arm::MAX_THETA2_DEG);
    
    setConsoleColor(COLOR_PROMPT);
    printf("  Press Enter to continue...");
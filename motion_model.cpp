@@ -0,0 +1,149 @@
+#include <cstring>
+#include <cmath>
+#include "motion_model.h"
+#include "scara_arm.h"
+using namespace openutils;
+
+/// Longest single-joint rotation the simulator accepts, assumed when the arm position is unknown.
+static const double MAX_TRAVEL = 2 * (Lab07Arm::MAX_THETA1_DEG > Lab07Arm::MAX_THETA2_DEG ?
+                                      Lab07Arm::MAX_THETA1_DEG : Lab07Arm::MAX_THETA2_DEG);
+
+CMotionModel::CMotionModel()
+{
+   double rate = MOTION_DEFAULT_RATE;
+   for(int i = 0; i < MOTION_SPEEDS; i++, rate /= 2)
+   {
+      m_profiles[i].overhead = MOTION_DEFAULT_OVERHEAD;
+      m_profiles[i].rate = rate;
+   }
+   m_penTime = MOTION_DEFAULT_PEN_TIME;
+   m_margin = MOTION_DEFAULT_MARGIN;
+   m_speed = MOTOR_SPEED_HIGH;
+   ClearSamples();
+   Forget();
+}
+
+void CMotionModel::Forget()
+{
+   m_bKnown = false;
+   m_j1 = m_j2 = 0;
+}
+
+void CMotionModel::SetPosition(double j1,double j2,MotorSpeed speed)
+{
+   m_bKnown = true;
+   m_j1 = j1;
+   m_j2 = j2;
+   m_speed = speed;
+}
+
+void CMotionModel::SetProfile(MotorSpeed speed,const CMotionProfile& profile)
+{
+   m_profiles[speed] = profile;
+}
+
+/**
+* Returns the ms the simulator needs for one command, margin included,
+* and moves the modelled arm as the simulator would. Moves it rejects
+* (out of range, or lines that do not parse) cost the overhead only.
+* @param cmd Parsed command
+* @param travel Set to the larger joint rotation in degrees, 0 if none. Output
+*/
+double CMotionModel::Estimate(const CParsedCommand& cmd,double* travel)
+{
+   const CMotionProfile& profile = m_profiles[m_speed];
+   double ms = profile.overhead,degrees = 0;
+   if(cmd.error == PARSE_OK)
+   {
+      switch(cmd.type)
+      {
+         case CMD_ROTATE_JOINT:
+         case CMD_HOME:
+         {
+            double j1 = cmd.type == CMD_HOME ? 0 : cmd.ang1;
+            double j2 = cmd.type == CMD_HOME ? 0 : cmd.ang2;
+            if(fabs(j1) > Lab07Arm::MAX_THETA1_DEG || fabs(j2) > Lab07Arm::MAX_THETA2_DEG) break;
+            degrees = m_bKnown ? fmax(fabs(j1 - m_j1),fabs(j2 - m_j2)) : MAX_TRAVEL;
+            if(profile.rate > 0) ms += 1000 * degrees / profile.rate;
+            SetPosition(j1,j2,m_speed);
+            break;
+         }
+         case CMD_PEN_UP:
+         case CMD_PEN_DOWN: ms += m_penTime; break;
+         case CMD_MOTOR_SPEED: m_speed = cmd.speed; break;
+         default: break;
+      }
+   }
+   if(travel != NULL) *travel = degrees;
+   return ms * (1 + m_margin);
+}
+
+/**
+* Returns the ms the simulator needs for every newline-separated command
+* in text, and moves the modelled arm past them.
+* @param text Command text
+* @param len Number of bytes
+*/
+double CMotionModel::Estimate(const char* text,int len)
+{
+   const char* end = text + len;
+   double ms = 0;
+   while(text < end)
+   {
+      const char* eol = (const char*)memchr(text,'\n',end - text);
+      if(eol == NULL) eol = end;
+      if(eol > text) // the simulator skips blank lines
+      {
+         CParsedCommand cmd;
+         CCommandParser::ParseLine(text,(int)(eol - text),&cmd);
+         ms += Estimate(cmd);
+      }
+      text = eol + 1;
+   }
+   return ms;
+}
+
+/**
+* Adds one timed command for Fit().
+* @param speed MOTOR_SPEED it ran at
+* @param travel Larger joint rotation in degrees, 0 for a command that does not move
+* @param ms Time it took, without margin
+*/
+void CMotionModel::Observe(MotorSpeed speed,double travel,double ms)
+{
+   CSamples& s = m_samples[speed];
+   s.n++;
+   s.travel += travel;
+   s.ms += ms;
+   s.travelSq += travel * travel;
+   s.travelMs += travel * ms;
+}
+
+/**
+* Fits overhead and rate to the timed moves of every speed that has at
+* least MOTION_MIN_SAMPLES of them, over more than one travel. A fit that
+* would give a negative overhead or rate is not applied.
+*/
+bool CMotionModel::Fit()
+{
+   bool changed = false;
+   for(int i = 0; i < MOTION_SPEEDS; i++)
+   {
+      const CSamples& s = m_samples[i];
+      if(s.n < MOTION_MIN_SAMPLES) continue;
+      double spread = s.n * s.travelSq - s.travel * s.travel;
+      if(spread <= 1e-9 * s.n * s.travelSq) continue; // every move the same length
+      double slope = (s.n * s.travelMs - s.travel * s.ms) / spread; // ms per degree
+      double overhead = (s.ms - slope * s.travel) / s.n;
+      if(slope <= 0 || overhead < 0) continue;
+      m_profiles[i].overhead = overhead;
+      m_profiles[i].rate = 1000 / slope;
+      changed = true;
+   }
+   return changed;
+}
+
+void CMotionModel::ClearSamples()
+{
+   memset(m_samples,0,sizeof(m_samples));
+}
@@ -0,0 +1,71 @@
+#ifndef _MOTION_MODEL_H_
+#define _MOTION_MODEL_H_
+
+#include "command_parser.h"
+
+#define MOTION_SPEEDS            3    /// MOTOR_SPEED settings, indexed by MotorSpeed
+#define MOTION_DEFAULT_OVERHEAD  5.0  /// ms the simulator spends on any command
+#define MOTION_DEFAULT_RATE      1800.0 /// deg/s at MOTOR_SPEED HIGH; MEDIUM and LOW halve it in turn
+#define MOTION_DEFAULT_PEN_TIME  20.0 /// ms to raise or lower the pen
+#define MOTION_DEFAULT_MARGIN    0.10 /// fraction added to every estimate
+#define MOTION_MIN_SAMPLES       4    /// timed moves per speed before Fit() replaces the defaults
+
+namespace openutils
+{
+   /// How long the simulator takes over commands at one MOTOR_SPEED setting.
+   struct CMotionProfile
+   {
+      double overhead; /// ms per command, moving or not
+      double rate; /// deg/s of the joint with the longer rotation
+   };
+
+   /**
+   * Estimates how long the simulator takes to carry out commands. The
+   * joints are interpolated together, so a move lasts as long as its
+   * larger rotation takes at the current MOTOR_SPEED: overhead + travel /
+   * rate, plus a safety margin. The model follows the arm through the
+   * commands it is shown, so it must see every command the simulator gets.
+   *
+   * The defaults fit the legacy 200 ms per command to the longest move at
+   * HIGH (340 degrees of J2). To calibrate, time moves of different
+   * lengths at each speed, e.g. with PACING_WINDOW and a window of 1
+   * against a simulator that acknowledges, and pass them to Observe();
+   * Fit() then solves overhead and rate by least squares.
+   */
+   class CMotionModel
+   {
+   private:
+      /// Running sums for the least-squares line ms = overhead + travel / rate.
+      struct CSamples
+      {
+         double n,travel,ms,travelSq,travelMs;
+      };
+
+      CMotionProfile m_profiles[MOTION_SPEEDS]; /// per MotorSpeed
+      CSamples m_samples[MOTION_SPEEDS]; /// timed moves per MotorSpeed
+      double m_penTime; /// ms per PEN_UP/PEN_DOWN
+      double m_margin; /// fraction added to every estimate
+      bool m_bKnown; /// m_j1/m_j2 are where the arm is
+      double m_j1,m_j2; /// joint angles after the commands seen, in degrees
+      MotorSpeed m_speed; /// MOTOR_SPEED after the commands seen
+   public:
+      CMotionModel(); /// Default profiles, arm position unknown
+      double Estimate(const CParsedCommand& cmd,double* travel = NULL); /// ms for one command; advances the arm
+      double Estimate(const char* text,int len); /// ms for newline-separated commands; advances the arm
+      void Forget(); /// Arm position unknown: the next move is assumed to be the longest
+      void SetPosition(double j1,double j2,MotorSpeed speed); /// Sets where the arm is
+      MotorSpeed GetSpeed() { return m_speed; } /// Returns the MOTOR_SPEED after the commands seen
+      void SetProfile(MotorSpeed speed,const CMotionProfile& profile); /// Replaces the timing of one speed
+      CMotionProfile GetProfile(MotorSpeed speed) { return m_profiles[speed]; } /// Returns the timing of one speed
+      void SetPenTime(double ms) { m_penTime = ms; } /// Sets the ms per PEN_UP/PEN_DOWN
+      double GetPenTime() { return m_penTime; } /// Returns the ms per PEN_UP/PEN_DOWN
+      void SetMargin(double margin) { m_margin = margin; } /// Sets the fraction added to every estimate
+      double GetMargin() { return m_margin; } /// Returns the fraction added to every estimate
+      void Observe(MotorSpeed speed,double travel,double ms); /// Adds one timed move for calibration
+      bool Fit(); /// Refits every speed with enough samples, true if any changed
+      int GetSampleCount(MotorSpeed speed) { return (int)m_samples[speed].n; } /// Returns the timed moves kept
+      void ClearSamples(); /// Forgets the timed moves
+   };
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include <cstring>
+#include "replay_journal.h"
+using namespace openutils;
+
+/// Calls f(cmd) for every line of text that parses.
+template<class F> static void eachCommand(const char* text,int len,F f)
+{
+   const char* end = text + len;
+   while(text < end)
+   {
+      const char* eol = (const char*)memchr(text,'\n',end - text);
+      if(eol == NULL) eol = end;
+      CParsedCommand cmd;
+      if(CCommandParser::ParseLine(text,(int)(eol - text),&cmd) == PARSE_OK) f(cmd);
+      text = eol + 1;
+   }
+}
+
+CArmState::CArmState()
+{
+   hasAngles = false;
+   ang1 = ang2 = 0;
+   penDown = false;
+   hasColor = false;
+   r = g = b = 0;
+   hasCycle = false;
+   cycle = false;
+   hasSpeed = false;
+   speed = MOTOR_SPEED_HIGH;
+}
+
+/**
+* Advances the state past newline-separated commands. Lines that do not
+* parse are ignored, as the simulator ignores them.
+* @param text Command text
+* @param len Number of bytes
+*/
+void CArmState::Apply(const char* text,int len)
+{
+   eachCommand(text,len,[this](const CParsedCommand& cmd)
+   {
+      switch(cmd.type)
+      {
+         case CMD_ROTATE_JOINT: hasAngles = true; ang1 = cmd.ang1; ang2 = cmd.ang2; break;
+         case CMD_HOME: hasAngles = true; ang1 = ang2 = 0; break;
+         case CMD_PEN_UP: penDown = false; break;
+         case CMD_PEN_DOWN: penDown = true; break;
+         case CMD_PEN_COLOR: hasColor = true; r = cmd.r; g = cmd.g; b = cmd.b; break;
+         case CMD_CYCLE_PEN_COLORS: hasCycle = true; cycle = cmd.on; break;
+         case CMD_MOTOR_SPEED: hasSpeed = true; speed = cmd.speed; break;
+         default: break;
+      }
+   });
+}
+
+/**
+* Encodes the commands that bring the simulator to this state without
+* drawing: speed and colour first, then the move with the pen up, then
+* the pen. Returns the number of bytes written.
+* @param buffer Destination, at least REPLAY_RESTORE_MAX bytes
+* @param capacity Size of buffer
+*/
+int CArmState::Restore(char* buffer,int capacity) const
+{
+   CCommandEncoder encoder(buffer,capacity);
+   if(hasSpeed) encoder.SetMotorSpeed(speed);
+   if(hasCycle) encoder.CyclePenColors(cycle);
+   if(hasColor) encoder.PenColor(r,g,b);
+   encoder.PenUp();
+   if(hasAngles) encoder.RotateJoint(ang1,ang2);
+   if(penDown) encoder.PenDown();
+   return encoder.GetLength();
+}
+
+CReplayJournal::CReplayJournal()
+{
+   m_nFirst = 0;
+}
+
+/**
+* Appends one entry: the commands written by one send, counted as one
+* command by the pacing that acknowledges it.
+* @param text Command text
+* @param len Number of bytes
+*/
+long CReplayJournal::Record(const char* text,int len)
+{
+   CEntry entry;
+   entry.text.assign(text,len);
+   entry.checkpoint = false;
+   eachCommand(text,len,[&entry](const CParsedCommand& cmd)
+   {
+      if(cmd.type == CMD_HOME || cmd.type == CMD_PEN_UP) entry.checkpoint = true;
+   });
+   m_entries.push_back(entry);
+   if(entry.checkpoint) m_checkpoints.push_back(GetNext() - 1);
+   return GetNext() - 1;
+}
+
+/**
+* Drops the entries before the newest checkpoint whose sequence number is
+* below executed, i.e. one the simulator is known to have carried out.
+* @param executed Entries before this sequence number have been executed
+*/
+void CReplayJournal::Trim(long executed)
+{
+   long keep = m_nFirst;
+   while(!m_checkpoints.empty() && m_checkpoints.front() < executed)
+   {
+      keep = m_checkpoints.front();
+      m_checkpoints.pop_front();
+   }
+   while(m_nFirst < keep)
+   {
+      const string& text = m_entries.front().text;
+      m_base.Apply(text.data(),(int)text.size());
+      m_entries.pop_front();
+      m_nFirst++;
+   }
+}
+
+void CReplayJournal::Clear()
+{
+   m_nFirst = GetNext();
+   m_entries.clear();
+   m_checkpoints.clear();
+   m_base = CArmState();
+}
+
+CArmState CReplayJournal::GetState(long seq)
+{
+   CArmState state = m_base;
+   for(long i = m_nFirst; i < seq && i < GetNext(); i++)
+   {
+      const string& text = m_entries[i - m_nFirst].text;
+      state.Apply(text.data(),(int)text.size());
+   }
+   return state;
+}
@@ -0,0 +1,71 @@
+#ifndef _REPLAY_JOURNAL_H_
+#define _REPLAY_JOURNAL_H_
+
+#include <string>
+#include <deque>
+using namespace std;
+#include "command_parser.h"
+
+#define REPLAY_RESTORE_MAX  256 /// bytes of commands a restore prelude can take
+
+namespace openutils
+{
+   /// The simulator state a replay has to re-establish. Fields not set by
+   /// any command so far are left alone on restore.
+   struct CArmState
+   {
+      bool hasAngles; /// ang1/ang2 are known
+      double ang1,ang2; /// last joint angles in degrees
+      bool penDown; /// pen state
+      bool hasColor; /// r/g/b are known
+      int r,g,b; /// pen colour
+      bool hasCycle; /// cycle is known
+      bool cycle; /// CYCLE_PEN_COLORS state
+      bool hasSpeed; /// speed is known
+      MotorSpeed speed; /// MOTOR_SPEED setting
+
+      CArmState(); /// Nothing known, pen up
+      void Apply(const char* text,int len); /// Advances past one or more commands
+      int Restore(char* buffer,int capacity) const; /// Encodes the commands that re-establish this state
+   };
+
+   /**
+   * Commands written since the last checkpoint, kept so a dropped
+   * connection can be resumed instead of restarted. Every entry has a
+   * sequence number; a checkpoint is an entry containing HOME or PEN_UP,
+   * after which the arm is in a state that does not depend on where the
+   * pen has been. Trim() forgets everything before the newest checkpoint
+   * the caller knows was executed, folding it into a base state, so the
+   * journal stays about one stroke long however long the job runs.
+   *
+   * To resume from sequence number n, send GetState(n).Restore() - pen up,
+   * back to the arm position, colour and speed of that moment, pen down
+   * again if it was - followed by entries n onwards.
+   */
+   class CReplayJournal
+   {
+   private:
+      struct CEntry
+      {
+         string text; /// one or more newline-terminated commands
+         bool checkpoint; /// contains HOME or PEN_UP
+      };
+
+      deque<CEntry> m_entries; /// journaled entries, oldest first
+      deque<long> m_checkpoints; /// sequence numbers of checkpoints not yet trimmed to
+      long m_nFirst; /// sequence number of m_entries.front()
+      CArmState m_base; /// state before m_entries.front()
+   public:
+      CReplayJournal(); /// Empty journal
+      long Record(const char* text,int len); /// Appends an entry, returns its sequence number
+      void Trim(long executed); /// Drops entries before the newest checkpoint below executed
+      void Clear(); /// Forgets everything, including the base state
+      long GetFirst() { return m_nFirst; } /// Sequence number of the oldest entry kept
+      long GetNext() { return m_nFirst + (long)m_entries.size(); } /// Sequence number of the next entry
+      int GetCount() { return (int)m_entries.size(); } /// Returns the number of entries kept
+      const string& Get(long seq) { return m_entries[seq - m_nFirst].text; } /// Returns an entry's commands
+      CArmState GetState(long seq); /// Returns the state just before entry seq
+   };
+}
+
+#endif
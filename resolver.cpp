@@ -0,0 +1,266 @@
+#include <cstring>
+#include "resolver.h"
+using namespace openutils;
+
+const SOCKADDR_IN* CHostEntry::FindIPv4() const
+{
+   for(size_t i = 0; i < addresses.size(); i++)
+      if(addresses[i].family == AF_INET) return (const SOCKADDR_IN*)&addresses[i].addr;
+   return NULL;
+}
+
+CResolver::CResolver()
+{
+   m_nTtl = RESOLVER_TTL;
+   m_nNegativeTtl = RESOLVER_NEGATIVE_TTL;
+   m_nLookups = 0;
+   m_nHits = 0;
+   m_bStopping = false;
+}
+
+CResolver::~CResolver()
+{
+   {
+      lock_guard<mutex> lock(m_lock);
+      m_bStopping = true;
+   }
+   m_queueChanged.notify_all();
+   if(m_worker.joinable()) m_worker.join();
+}
+
+CResolver& CResolver::Instance()
+{
+   static CResolver resolver;
+   return resolver;
+}
+
+/**
+* Returns what host resolves to. A fresh cached result is returned at
+* once; otherwise getaddrinfo() is called on this thread and its result
+* (success or failure) is cached. Never returns NULL: check IsValid().
+* @param host Host name or numeric address
+*/
+HostEntryPtr CResolver::Resolve(const char* host)
+{
+   string key = host;
+   HostEntryPtr entry;
+   {
+      lock_guard<mutex> lock(m_lock);
+      if(Find(key,&entry)) return entry;
+   }
+   entry = Query(key);
+   lock_guard<mutex> lock(m_lock);
+   m_nLookups++;
+   return Store(entry);
+}
+
+/**
+* Returns the cached result for host without blocking. Returns false if
+* the host has not been resolved yet or its result has expired.
+* @param host Host name or numeric address
+* @param entry Receives the cached result
+*/
+bool CResolver::Lookup(const char* host,HostEntryPtr* entry)
+{
+   lock_guard<mutex> lock(m_lock);
+   return Find(host,entry);
+}
+
+/**
+* Resolves host on the worker thread. A cached result completes the
+* future immediately. Lookups are made one at a time in the order they
+* were asked for, and a host asked for twice is only looked up once.
+* @param host Host name or numeric address
+*/
+future<HostEntryPtr> CResolver::ResolveAsync(const char* host)
+{
+   CRequest request;
+   request.host = host;
+   future<HostEntryPtr> result = request.done.get_future();
+   Submit(request);
+   return result;
+}
+
+/**
+* Resolves host on the worker thread and passes the result to callback.
+* On a cache hit the callback runs on the calling thread before this
+* returns; otherwise it runs on the worker thread and must not block.
+* @param host Host name or numeric address
+* @param callback Called with the result
+*/
+void CResolver::ResolveAsync(const char* host,ResolveCallback callback)
+{
+   CRequest request;
+   request.host = host;
+   request.callback = callback;
+   Submit(request);
+}
+
+/**
+* Sets how long results are served from the cache. Results already
+* cached keep the expiry they were stored with.
+* @param ttl ms successful lookups are kept, 0 to disable caching, -1 for ever
+* @param negativeTtl ms failed lookups are kept
+*/
+void CResolver::SetTtl(int ttl,int negativeTtl)
+{
+   lock_guard<mutex> lock(m_lock);
+   m_nTtl = ttl;
+   m_nNegativeTtl = negativeTtl;
+}
+
+void CResolver::Forget(const char* host)
+{
+   lock_guard<mutex> lock(m_lock);
+   m_cache.erase(host);
+}
+
+void CResolver::Clear()
+{
+   lock_guard<mutex> lock(m_lock);
+   m_cache.clear();
+}
+
+bool CResolver::Find(const string& host,HostEntryPtr* entry)
+{
+   unordered_map<string,CCacheEntry>::iterator it = m_cache.find(host);
+   if(it == m_cache.end()) return false;
+   if(chrono::steady_clock::now() >= it->second.expires)
+   {
+      m_cache.erase(it);
+      return false;
+   }
+   m_nHits++;
+   *entry = it->second.entry;
+   return true;
+}
+
+/**
+* Caches a result under the name it was looked up by and returns it. When
+* the cache is full, expired entries are dropped first, then the one that
+* would expire soonest.
+*/
+HostEntryPtr CResolver::Store(HostEntryPtr entry)
+{
+   int ttl = entry->error == 0 ? m_nTtl : m_nNegativeTtl;
+   if(ttl == 0) return entry;
+   chrono::steady_clock::time_point now = chrono::steady_clock::now();
+   if(m_cache.size() >= RESOLVER_MAX_ENTRIES && m_cache.find(entry->host) == m_cache.end())
+   {
+      unordered_map<string,CCacheEntry>::iterator oldest = m_cache.begin();
+      for(unordered_map<string,CCacheEntry>::iterator it = m_cache.begin(); it != m_cache.end(); )
+      {
+         if(it->second.expires <= now)
+         {
+            it = m_cache.erase(it);
+            oldest = m_cache.begin();
+            continue;
+         }
+         if(it->second.expires < oldest->second.expires) oldest = it;
+         ++it;
+      }
+      if(m_cache.size() >= RESOLVER_MAX_ENTRIES) m_cache.erase(oldest);
+   }
+   CCacheEntry& cached = m_cache[entry->host];
+   cached.entry = entry;
+   cached.expires = ttl < 0 ? chrono::steady_clock::time_point::max() : now + chrono::milliseconds(ttl);
+   return entry;
+}
+
+/**
+* Completes a request from the cache, or queues it for the worker thread,
+* starting the thread the first time.
+*/
+void CResolver::Submit(CRequest& request)
+{
+   HostEntryPtr entry;
+   unique_lock<mutex> lock(m_lock);
+   if(Find(request.host,&entry))
+   {
+      lock.unlock();
+      request.done.set_value(entry);
+      if(request.callback) request.callback(entry);
+      return;
+   }
+   if(!m_worker.joinable()) m_worker = thread(&CResolver::WorkerLoop,this);
+   m_queue.push_back(move(request));
+   lock.unlock();
+   m_queueChanged.notify_all();
+}
+
+/**
+* Worker thread. Takes one request at a time; requests for a host an
+* earlier request has just resolved are answered from the cache.
+*/
+void CResolver::WorkerLoop()
+{
+   while(true)
+   {
+      CRequest request;
+      HostEntryPtr entry;
+      {
+         unique_lock<mutex> lock(m_lock);
+         while(m_queue.empty() && !m_bStopping)
+            m_queueChanged.wait(lock);
+         if(m_queue.empty()) return;
+         request = move(m_queue.front());
+         m_queue.pop_front();
+         Find(request.host,&entry);
+      }
+      if(!entry)
+      {
+         entry = Query(request.host);
+         lock_guard<mutex> lock(m_lock);
+         m_nLookups++;
+         Store(entry);
+      }
+      request.done.set_value(entry);
+      if(request.callback) request.callback(entry);
+   }
+}
+
+/**
+* Looks host up with getaddrinfo(), keeping every IPv4 and IPv6 stream
+* address once, in the order returned. getaddrinfo() has no alias list;
+* when the name given is not the canonical one it is reported as an alias.
+*/
+HostEntryPtr CResolver::Query(const string& host)
+{
+   shared_ptr<CHostEntry> entry = make_shared<CHostEntry>();
+   entry->host = host;
+   entry->error = 0;
+
+   struct addrinfo hints;
+   struct addrinfo* result = NULL;
+   memset(&hints,0,sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags = AI_CANONNAME;
+   int nret = getaddrinfo(host.c_str(),NULL,&hints,&result);
+   if(nret != 0)
+   {
+      entry->error = nret;
+      return entry;
+   }
+
+   entry->name = (result->ai_canonname != NULL) ? result->ai_canonname : host;
+   if(entry->name != host) entry->aliases.push_back(host);
+   for(struct addrinfo* ai = result; ai != NULL; ai = ai->ai_next)
+   {
+      if(ai->ai_family != AF_INET && ai->ai_family != AF_INET6) continue;
+      if(ai->ai_addrlen > sizeof(struct sockaddr_storage)) continue;
+      bool seen = false;
+      for(size_t i = 0; i < entry->addresses.size() && !seen; i++)
+         seen = entry->addresses[i].length == (int)ai->ai_addrlen && memcmp(&entry->addresses[i].addr,ai->ai_addr,ai->ai_addrlen) == 0;
+      if(seen) continue;
+      CHostAddress address;
+      memset(&address,0,sizeof(address));
+      memcpy(&address.addr,ai->ai_addr,ai->ai_addrlen);
+      address.length = (int)ai->ai_addrlen;
+      address.family = ai->ai_family;
+      entry->addresses.push_back(address);
+   }
+   freeaddrinfo(result);
+   if(entry->addresses.empty()) entry->error = EAI_NONAME;
+   return entry;
+}
@@ -0,0 +1,104 @@
+#ifndef _RESOLVER_H_
+#define _RESOLVER_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <chrono>
+using namespace std;
+#include "socket_platform.h"
+
+#define RESOLVER_TTL           60000 /// ms a successful lookup is served from the cache
+#define RESOLVER_NEGATIVE_TTL  2000  /// ms a failed lookup is remembered
+#define RESOLVER_MAX_ENTRIES   256   /// hosts kept before the oldest lookups are evicted
+
+namespace openutils
+{
+   /// One resolved address, IPv4 or IPv6, ready to pass to connect().
+   struct CHostAddress
+   {
+      struct sockaddr_storage addr; /// the address, port 0
+      int length; /// bytes of addr in use
+      int family; /// AF_INET or AF_INET6
+   };
+
+   /// Result of a lookup. Shared and never modified once published.
+   struct CHostEntry
+   {
+      string host; /// name that was looked up
+      int error; /// 0, or the getaddrinfo() error code
+      string name; /// official (canonical) name
+      vector<string> aliases; /// other names the host went by during the lookup
+      vector<CHostAddress> addresses; /// addresses in the order the system prefers them
+
+      bool IsValid() const { return error == 0 && !addresses.empty(); } /// True if there is an address to use
+      const SOCKADDR_IN* FindIPv4() const; /// Returns the first IPv4 address, or NULL
+   };
+
+   typedef shared_ptr<const CHostEntry> HostEntryPtr;
+   /// Completion callback for asynchronous lookups.
+   typedef function<void(HostEntryPtr entry)> ResolveCallback;
+
+   /**
+   * Process-wide host name cache in front of getaddrinfo(). A lookup is
+   * made once and then answered from memory until its TTL runs out, so
+   * reconnecting and re-binding never wait on the resolver again; failures
+   * are cached briefly so a bad name does not hammer DNS either. Lookups
+   * that miss can be handed to a background thread with ResolveAsync(),
+   * which the first call starts.
+   */
+   class CResolver
+   {
+   private:
+      struct CCacheEntry
+      {
+         HostEntryPtr entry; /// published result
+         chrono::steady_clock::time_point expires; /// when the result goes stale
+      };
+      struct CRequest
+      {
+         string host; /// name to look up
+         promise<HostEntryPtr> done; /// fulfilled with the result
+         ResolveCallback callback; /// optional completion callback
+      };
+
+      unordered_map<string,CCacheEntry> m_cache; /// results by host name
+      int m_nTtl; /// ms successful lookups are kept, -1 for ever
+      int m_nNegativeTtl; /// ms failed lookups are kept
+      long m_nLookups; /// getaddrinfo() calls made
+      long m_nHits; /// lookups answered from the cache
+      mutex m_lock; /// guards everything above and the request queue
+      condition_variable m_queueChanged; /// signalled when a request is queued
+      deque<CRequest> m_queue; /// lookups waiting for the worker thread
+      thread m_worker; /// runs queued lookups, started on first use
+      bool m_bStopping; /// asks the worker thread to exit
+   public:
+      CResolver(); /// Empty cache with the default TTLs
+      ~CResolver(); /// Stops the worker thread
+      static CResolver& Instance(); /// The cache shared by every socket
+      HostEntryPtr Resolve(const char* host); /// Returns the cached result, looking the host up on a miss
+      bool Lookup(const char* host,HostEntryPtr* entry); /// Returns the cached result without blocking, false on a miss
+      future<HostEntryPtr> ResolveAsync(const char* host); /// Resolves on the worker thread
+      void ResolveAsync(const char* host,ResolveCallback callback); /// Resolves on the worker thread, reports through callback
+      void SetTtl(int ttl,int negativeTtl = RESOLVER_NEGATIVE_TTL); /// Sets how long results are kept, in ms
+      void Forget(const char* host); /// Drops one host so the next lookup asks again
+      void Clear(); /// Drops every cached result
+      long GetLookupCount() { return m_nLookups; } /// Returns the getaddrinfo() calls made
+      long GetHitCount() { return m_nHits; } /// Returns the lookups answered from the cache
+   private:
+      bool Find(const string& host,HostEntryPtr* entry); /// Cache lookup, caller holds m_lock
+      HostEntryPtr Store(HostEntryPtr entry); /// Publishes a result, caller holds m_lock
+      void Submit(CRequest& request); /// Queues a request, starting the worker if needed
+      void WorkerLoop(); /// Body of the worker thread
+      static HostEntryPtr Query(const string& host); /// Calls getaddrinfo()
+   };
+}
+
+#endif
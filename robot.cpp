@@ -1,28 +1,53 @@
+#include <cstring>
 #include <string>
 #include <vector>
 using namespace std;
-#include <windows.h>
 #include "robot.h"
+#include "resolver.h"
+#include "scara_arm.h"
+#ifdef _WIN32
 #include <conio.h>
+#define CLEAR_SCREEN "cls"
+#else
+#define getch getchar
+#define CLEAR_SCREEN "clear"
+#endif
 using namespace openutils;
 
-#pragma warning (disable : 4290)
+// Instrumentation hooks; with SCARA_STATS undefined they compile to nothing.
+// All but STATS_START, which declares t, are single statements.
+#ifdef SCARA_STATS
+#define STATS_START(t)        uint64_t t = CRobotStats::Now()
+#define STATS_RECORD(h,t,n)   do { m_stats->h.Record((CRobotStats::Now() - (t)) / (n),(n)); } while(0)
+#define STATS_ADD(counter,n)  do { CRobotStats::Add(m_stats->counter,(n)); } while(0)
+#define STATS_DUMP()          do { if(m_statsOut != NULL) DumpStats(); } while(0)
+#else
+#define STATS_START(t)
+#define STATS_RECORD(h,t,n)   do { } while(0)
+#define STATS_ADD(counter,n)  do { } while(0)
+#define STATS_DUMP()          do { } while(0)
+#endif
 
 void CWinSock::Initialize() 
 {
-   WORD ver = MAKEWORD(1, 1);
+#ifdef _WIN32
+   WORD ver = MAKEWORD(2, 2);
    WSADATA wsadata;
    WSAStartup(ver, &wsadata);
+#endif
 }
 
 
 void CWinSock::Finalize()
 {
+#ifdef _WIN32
    WSACleanup();
+#endif
 }
 
 CServerSocket::CServerSocket()
 {
+   m_socket = INVALID_SOCKET;
    m_nPort = 80;
    m_nQueue = 10;
    Init();
@@ -30,6 +55,7 @@ CServerSocket::CServerSocket()
 
 CServerSocket::CServerSocket(int port)
 {
+   m_socket = INVALID_SOCKET;
    m_nPort = port;
    m_nQueue = 10;
    Init();
@@ -37,6 +63,7 @@ CServerSocket::CServerSocket(int port)
 
 CServerSocket::CServerSocket(int port,int queue)
 {
+   m_socket = INVALID_SOCKET;
    m_nPort = port;
    m_nQueue = queue;
    Init();
@@ -54,15 +81,20 @@ void CServerSocket::Bind(CSocketAddress *sock_addr)
 }
 
 /**
-* Listens and accepts a client.Returns the accepted connection.
+* Binds the server (once) and starts listening, without waiting for a
+* client. Accept() does this itself; an event loop calls it up front.
 */
-CRobot* CServerSocket::Accept() throw (CSocketException)
+void CServerSocket::Listen() throw (CSocketException)
 {
    if(m_sockAddr != NULL) 
       m_sockAddrIn = m_sockAddr->GetSockAddrIn();
    if(!m_bBound) 
    {
       m_socket = socket(AF_INET,SOCK_STREAM,IPPROTO_TCP);
+#ifndef _WIN32
+      int reuse = 1; // restart without waiting out TIME_WAIT
+      setsockopt(m_socket,SOL_SOCKET,SO_REUSEADDR,(const char*)&reuse,sizeof(reuse));
+#endif
       int nret = bind(m_socket, (LPSOCKADDR)&m_sockAddrIn, sizeof(struct sockaddr));
       if (nret == SOCKET_ERROR) 
       {
@@ -77,14 +109,25 @@ CRobot* CServerSocket::Accept() throw (CSocketException)
       nret = WSAGetLastError();
       throw CSocketException(nret, "Failed to listen: Accept()");
    }
+}
+
+/**
+* Listens and accepts a client.Returns the accepted connection. If the
+* listening socket has been made non-blocking and no client is waiting,
+* returns NULL instead.
+*/
+CRobot* CServerSocket::Accept() throw (CSocketException)
+{
+   if(!m_bBound) Listen();
    SOCKET theClient;
    SOCKADDR_IN clientAddr;
-   int ssz = sizeof(struct sockaddr);
+   socklen_t ssz = sizeof(struct sockaddr);
    theClient = accept(m_socket,(LPSOCKADDR)&clientAddr,&ssz);
    //theClient = accept(m_socket,NULL,NULL);
    if (theClient == INVALID_SOCKET) 
    {
       int nret = WSAGetLastError();
+      if(SocketWouldBlock(nret)) return NULL;
       throw CSocketException(nret, "Invalid client socket: Accept()");
    }
    CRobot *sockClient = new CRobot();
@@ -95,7 +138,8 @@ CRobot* CServerSocket::Accept() throw (CSocketException)
 
 void CServerSocket::Close()
 {
-   closesocket(m_socket);
+   if(m_socket != INVALID_SOCKET) closesocket(m_socket);
+   m_socket = INVALID_SOCKET;
    m_sockAddr = NULL;
    m_bBound = false;
    m_bListening = false;
@@ -156,7 +200,38 @@ bool CServerSocket::IsListening()
 
 CRobot::CRobot()
 {
+   m_socket = INVALID_SOCKET;
    m_clientAddr = NULL;
+   m_pacing = PACING_LEGACY;
+   m_nWindow = DEFAULT_ACK_WINDOW;
+   m_nAckTimeout = DEFAULT_ACK_TIMEOUT;
+   m_nInFlight = 0;
+   m_nQueueCapacity = DEFAULT_ASYNC_QUEUE;
+   m_nQueueBusy = 0;
+   m_bAsync = false;
+   m_bStopping = false;
+   m_nRingHead = 0;
+   m_nRingTail = 0;
+   m_nAcksPending = 0;
+   m_nDroppedLines = 0;
+   m_bPeerClosed = false;
+   m_bNonBlocking = false;
+   m_nOutgoingSent = 0;
+   m_nPort = 0;
+   m_bResilient = false;
+   m_nMaxReconnects = DEFAULT_RECONNECT_ATTEMPTS;
+   m_nReconnects = 0;
+   m_nWritten = 0;
+   m_nReplayFrom = 0;
+   m_stats = NULL;
+#ifdef SCARA_STATS
+   m_stats = new CRobotStats();
+#endif
+   m_statsOut = NULL;
+   m_nStatsInterval = 0;
+   m_nStatsStart = m_nStatsDumped = CRobotStats::Now();
+   m_nBusyUntil = 0;
+   m_nLookahead = DEFAULT_LOOKAHEAD;
 }
 
 void CRobot::SetSocket(SOCKET sock) 
@@ -180,66 +255,382 @@ int CRobot::Connect()
    {
       printf("Cannot connect to NULL host");
    }
-   Connect(m_clientAddr->GetName(),m_clientAddr->GetPort());
+   Connect(m_clientAddr->GetHostName(),m_clientAddr->GetPort());
    return 1;
 }
 
 /**
-* Connects to a server
+* Connects to a server. The host is resolved through the resolver cache
+* and every address it has is tried (see ConnectAny()); the whole call,
+* lookup included, gives up after timeout ms instead of waiting out the
+* system's connect timeout.
 * @param host_name Server name
 * @param port Port to connect
+* @param timeout Time allowed in ms, -1 for no limit
 */
-int CRobot::Connect(const char* host_name,int port) 
+int CRobot::Connect(const char* host_name,int port,int timeout) 
 {
-   int nret;
-   LPHOSTENT hostEntry;
-   hostEntry = gethostbyname(host_name);
-   if (!hostEntry)
+   m_strHost = host_name;
+   m_nPort = port;
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   future<HostEntryPtr> lookup = CResolver::Instance().ResolveAsync(host_name);
+   if(timeout >= 0 && lookup.wait_for(chrono::milliseconds(timeout)) != future_status::ready)
    {
-      nret = WSAGetLastError();
       printf("Failed to resolve host");
       return 0;
    }
-
-   m_socket = socket(AF_INET,SOCK_STREAM,IPPROTO_TCP);
-   if (m_socket == INVALID_SOCKET)
+   HostEntryPtr host = lookup.get();
+   if (!host->IsValid())
    {
-      nret = WSAGetLastError();
-      printf("Failed to create client socket");
+      printf("Failed to resolve host");
       return 0;
    }
 
-   SOCKADDR_IN serverInfo;
-   serverInfo.sin_family = AF_INET;
-   serverInfo.sin_addr = *((LPIN_ADDR)*hostEntry->h_addr_list);
-   serverInfo.sin_port = htons(port);
-   nret = connect(m_socket,(LPSOCKADDR)&serverInfo,sizeof(struct sockaddr));
-   if (nret == SOCKET_ERROR) 
+   if(timeout >= 0)
+   {
+      timeout -= (int)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+      if(timeout < 0) timeout = 0;
+   }
+   SOCKET s = ConnectAny(*host,port,timeout);
+   if (s == INVALID_SOCKET) 
    {
-      nret = WSAGetLastError();
       printf("Connect failed.");
       return 0;
    }
-
+   m_socket = s;
+   m_nRingHead = m_nRingTail = 0;
+   m_nAcksPending = 0;
+   m_bPeerClosed = false;
    return 1;
 }
 
 /**
-* Writes data to the socket. Returns number of bytes written
+* Connects to whichever address of host answers first, Happy Eyeballs
+* style (RFC 8305). Address families are interleaved, the resolver's
+* preference first; a non-blocking connect is started on the first
+* address, and on the next one whenever CONNECT_ATTEMPT_DELAY ms pass
+* without an answer or an attempt fails. The first attempt to complete
+* wins and the rest are abandoned. Returns the connected, blocking socket,
+* or INVALID_SOCKET if every address failed or timeout ms passed.
+* @param host Resolved host
+* @param port Port to connect
+* @param timeout Time allowed in ms, -1 for no limit
+*/
+SOCKET CRobot::ConnectAny(const CHostEntry& host,int port,int timeout)
+{
+   vector<const CHostAddress*> primary,secondary,order;
+   for(size_t i = 0; i < host.addresses.size(); i++)
+      (host.addresses[i].family == host.addresses[0].family ? primary : secondary).push_back(&host.addresses[i]);
+   for(size_t i = 0; i < primary.size() || i < secondary.size(); i++)
+   {
+      if(i < primary.size()) order.push_back(primary[i]);
+      if(i < secondary.size()) order.push_back(secondary[i]);
+   }
+
+   chrono::steady_clock::time_point now = chrono::steady_clock::now();
+   chrono::steady_clock::time_point deadline = now + chrono::milliseconds(timeout < 0 ? 0 : timeout);
+   chrono::steady_clock::time_point nextStart = now;
+   vector<SOCKET> attempts;
+   SOCKET winner = INVALID_SOCKET;
+   size_t next = 0;
+
+   while(winner == INVALID_SOCKET)
+   {
+      now = chrono::steady_clock::now();
+      if(timeout >= 0 && now >= deadline) break;
+
+      if(next < order.size() && now >= nextStart)
+      {
+         CHostAddress target = *order[next++];
+         if(target.family == AF_INET) ((struct sockaddr_in*)&target.addr)->sin_port = htons(port);
+         else ((struct sockaddr_in6*)&target.addr)->sin6_port = htons(port);
+         nextStart = now + chrono::milliseconds(CONNECT_ATTEMPT_DELAY);
+
+         SOCKET s = socket(target.family,SOCK_STREAM,IPPROTO_TCP);
+         if(s == INVALID_SOCKET || !SetSocketBlocking(s,false))
+         {
+            if(s != INVALID_SOCKET) closesocket(s);
+            nextStart = now;
+            continue;
+         }
+         if(connect(s,(LPSOCKADDR)&target.addr,target.length) == 0)
+         {
+            winner = s;
+            break;
+         }
+         int nret = WSAGetLastError();
+         if(nret != WSAEINPROGRESS && !SocketWouldBlock(nret))
+         {
+            closesocket(s);
+            nextStart = now;
+            continue;
+         }
+         attempts.push_back(s);
+      }
+      if(attempts.empty())
+      {
+         if(next < order.size()) continue;
+         break;
+      }
+
+      // Wait until an attempt completes, the next one is due, or time is up
+      chrono::steady_clock::time_point until = deadline;
+      if(next < order.size() && (timeout < 0 || nextStart < until)) until = nextStart;
+      int wait = (timeout < 0 && next >= order.size()) ? -1 :
+         (int)chrono::duration_cast<chrono::milliseconds>(until - now).count() + 1;
+#ifdef _WIN32
+      fd_set writeSet,errorSet;
+      timeval tv;
+      FD_ZERO(&writeSet);
+      FD_ZERO(&errorSet);
+      for(size_t i = 0; i < attempts.size(); i++)
+      {
+         FD_SET(attempts[i],&writeSet);
+         FD_SET(attempts[i],&errorSet);
+      }
+      tv.tv_sec = wait / 1000;
+      tv.tv_usec = (wait % 1000) * 1000;
+      if(select(0,NULL,&writeSet,&errorSet,wait < 0 ? NULL : &tv) <= 0) continue;
+#else
+      vector<struct pollfd> fds(attempts.size());
+      for(size_t i = 0; i < attempts.size(); i++)
+      {
+         fds[i].fd = attempts[i];
+         fds[i].events = POLLOUT;
+         fds[i].revents = 0;
+      }
+      if(poll(&fds[0],fds.size(),wait) <= 0) continue;
+#endif
+
+      for(size_t i = attempts.size(); i-- > 0; )
+      {
+#ifdef _WIN32
+         bool done = FD_ISSET(attempts[i],&writeSet) || FD_ISSET(attempts[i],&errorSet);
+#else
+         bool done = fds[i].revents != 0;
+#endif
+         if(!done) continue;
+         int error = 0;
+         socklen_t len = sizeof(error);
+         if(getsockopt(attempts[i],SOL_SOCKET,SO_ERROR,(char*)&error,&len) == 0 && error == 0 && winner == INVALID_SOCKET)
+            winner = attempts[i];
+         else
+         {
+            closesocket(attempts[i]);
+            nextStart = chrono::steady_clock::now(); // a failure starts the next attempt at once
+         }
+         attempts.erase(attempts.begin() + i);
+      }
+   }
+
+   for(size_t i = 0; i < attempts.size(); i++)
+      closesocket(attempts[i]);
+   if(winner != INVALID_SOCKET) SetSocketBlocking(winner,true);
+   return winner;
+}
+
+/**
+* Writes data to the socket as is. Returns number of bytes written; in
+* resilient mode that includes bytes left to the replay after a failure.
+* Each non-blank line counts as one command for pacing and, in resilient
+* mode, is journaled on its own, so a failure reconnects and replays from
+* the right line instead of throwing.
 * @param data data to write
 */
 int CRobot::Send(const char* data) throw (CSocketException)
 {
-   int len,nret=0,nSent,nTotalSent=0;
+   if(m_bAsync && !IsSenderThread())
+      return Enqueue(data).get();
+   STATS_START(start);
+   int len = (int)strlen(data),commands = 0;
+   for(const char* line = data; line < data + len; )
+   {
+      const char* eol = (const char*)memchr(line,'\n',data + len - line);
+      const char* next = eol == NULL ? data + len : eol + 1;
+      if(line != eol) // the simulator skips blank lines
+      {
+         if(m_bResilient) m_journal.Record(line,(int)(next - line));
+         commands++;
+      }
+      line = next;
+   }
+   try
+   {
+      SendAll(data,len);
+      if(m_bResilient) m_nWritten = m_journal.GetNext();
+      Pace(data,len,commands);
+   }
+   catch(CSocketException&)
+   {
+      if(!m_bResilient) throw;
+      Recover();
+   }
+   STATS_RECORD(command,start,commands > 0 ? commands : 1);
+   STATS_ADD(commands,commands);
+   STATS_DUMP();
+   return len;
+}
+
+/**
+* Writes every command in the batch. In async mode the batch is queued
+* behind earlier submissions and this call waits for it to be written.
+* Returns number of bytes written.
+* @param batch Commands to write
+*/
+int CRobot::SendBatch(CCommandBatch& batch) throw (CSocketException)
+{
+   if(m_bAsync && !IsSenderThread())
+      return Enqueue(batch).get();
+   return WriteBatch(batch);
+}
+
+/**
+* Writes commands first..last-1 of a buffer that is already split into
+* commands, such as a compiled job mapped from disk, without copying it:
+* command i spans [i == 0 ? 0 : ends[i-1], ends[i]) of data and ends in
+* '\n'. Pacing and resilient mode apply as for SendBatch(). In async mode
+* the commands are copied onto the queue behind earlier submissions.
+* Returns number of bytes written.
+* @param data Command text
+* @param ends Offset just past the '\n' of each command
+* @param first Index of the first command to write
+* @param last Index just past the last command to write
+*/
+int CRobot::SendCommands(const char* data,const int* ends,int first,int last) throw (CSocketException)
+{
+   if(first >= last) return 0;
+   if(m_bAsync && !IsSenderThread())
+   {
+      CCommandBatch batch;
+      int start = first == 0 ? 0 : ends[first-1];
+      batch.Add(data + start,ends[last-1] - start);
+      return Enqueue(batch).get();
+   }
+   return WriteCommands(data,ends,first,last);
+}
 
-   len=strlen(data);
+/**
+* Writes every command in the batch. The whole batch goes out in a single
+* send loop, except in window mode where it is split so that no more than
+* the window is ever in flight (predicted to be running, in predictive
+* mode). Returns number of bytes written.
+* @param batch Commands to write
+* @param written Set to the number of commands written in full, also when it throws. Output, optional
+*/
+int CRobot::WriteBatch(CCommandBatch& batch,int* written) throw (CSocketException)
+{
+   return WriteCommands(batch.GetData(),batch.GetEnds(),0,batch.GetCount(),written);
+}
+
+/**
+* Writes commands first..count-1 of data, where command i spans
+* [i == 0 ? 0 : ends[i-1], ends[i]). Splits them for window and predictive
+* pacing as WriteBatch() describes. Returns number of bytes written.
+* @param data Command text
+* @param ends Offset just past the '\n' of each command
+* @param first Index of the first command to write
+* @param count Index just past the last command to write
+* @param written Set to the index just past the last command written in full, also when it throws. Output, optional
+*/
+int CRobot::WriteCommands(const char* data,const int* ends,int first,int count,int* written) throw (CSocketException)
+{
+   int last = first,nret,nTotalSent = 0;
+   if(written != NULL) *written = first;
+
+   while(first < count)
+   {
+      bool recorded = false;
+      try
+      {
+         last = count;
+         if(m_pacing == PACING_WINDOW || m_pacing == PACING_PREDICTIVE)
+         {
+            if(m_nInFlight >= m_nWindow)
+            {
+               if(m_pacing == PACING_WINDOW) WaitForAck(m_nAckTimeout);
+               else WaitPredicted(m_nWindow - 1);
+               continue;
+            }
+            if(last - first > m_nWindow - m_nInFlight)
+               last = first + m_nWindow - m_nInFlight;
+         }
+         STATS_START(started);
+         int start = first == 0 ? 0 : ends[first-1],length = ends[last-1] - start;
+         if(m_bResilient)
+         {
+            for(int i = first; i < last; i++)
+            {
+               int from = i == 0 ? 0 : ends[i-1];
+               m_journal.Record(data + from,ends[i] - from);
+            }
+            recorded = true;
+            nTotalSent += length; // from here on a failure resends it from the journal
+         }
+         nret = SendAll(data + start,length);
+         if(written != NULL) *written = last;
+         if(m_bResilient) m_nWritten = m_journal.GetNext();
+         else nTotalSent += nret;
+         Pace(data + start,length,last - first);
+         STATS_RECORD(command,started,last - first);
+         STATS_ADD(commands,last - first);
+      }
+      catch(CSocketException&)
+      {
+         if(!m_bResilient) throw;
+         Recover();
+         if(!recorded) continue;
+      }
+      first = last;
+   }
+   STATS_DUMP();
+   return nTotalSent;
+}
+
+/**
+* Writes len bytes to the socket, looping until all of them are accepted.
+* Anything still pending from Post() goes first. Returns number of bytes
+* written.
+* @param data data to write
+* @param len number of bytes to write
+*/
+int CRobot::SendAll(const char* data,int len) throw (CSocketException)
+{
+   if(GetPendingOutput() > 0)
+   {
+      SendRaw(m_outgoing.data() + m_nOutgoingSent,GetPendingOutput(),true);
+      m_outgoing.clear();
+      m_nOutgoingSent = 0;
+   }
+   return SendRaw(data,len,true);
+}
+
+/**
+* Writes len bytes to the socket. On a non-blocking socket that is full,
+* waits for room if wait is true and returns early otherwise.
+* Returns number of bytes written.
+* @param data data to write
+* @param len number of bytes to write
+* @param wait true to block until everything is written
+*/
+int CRobot::SendRaw(const char* data,int len,bool wait) throw (CSocketException)
+{
+   int nret,nSent,nTotalSent=0;
+   STATS_START(start);
 
    while(nTotalSent<len)
    {
-      nSent = send(m_socket,data+nTotalSent,len-nTotalSent,0);
+      nSent = send(m_socket,data+nTotalSent,len-nTotalSent,SOCKET_SEND_FLAGS);
+      STATS_ADD(sendCalls,1);
       if(nSent == SOCKET_ERROR)
       {
          nret = WSAGetLastError();
+         if(SocketWouldBlock(nret))
+         {
+            if(!wait) break;
+            STATS_ADD(sendWaits,1);
+            if(WaitSocket(m_socket,true,-1) != SOCKET_ERROR) continue;
+            nret = WSAGetLastError();
+         }
          throw CSocketException(nret, "Network failure: Send()");		
       }
       else
@@ -247,39 +638,868 @@ int CRobot::Send(const char* data) throw (CSocketException)
          nTotalSent+=nSent;
       }
    }
-   Sleep(200);
-   return nret;
+   STATS_ADD(bytesSent,nTotalSent);
+   STATS_RECORD(send,start,1);
+   return nTotalSent;
+}
+
+/**
+* Puts the socket in non-blocking mode, as an event loop needs. Read(),
+* Send() and the other blocking calls keep working and wait as before.
+* @param on true for non-blocking
+*/
+void CRobot::SetNonBlocking(bool on)
+{
+   if(SetSocketBlocking(m_socket,!on)) m_bNonBlocking = on;
+}
+
+/**
+* Writes as much of data as the socket accepts without blocking and keeps
+* the rest, in order, for Flush(). No pacing is applied. Returns the
+* number of bytes written immediately.
+* @param data data to write
+* @param len number of bytes to write
+*/
+int CRobot::Post(const char* data,int len) throw (CSocketException)
+{
+   int written = 0;
+   if(GetPendingOutput() == 0)
+      written = SendRaw(data,len,false);
+   if(written < len)
+   {
+      if(m_nOutgoingSent == m_outgoing.size())
+      {
+         m_outgoing.clear();
+         m_nOutgoingSent = 0;
+      }
+      m_outgoing.append(data + written,len - written);
+   }
+   return written;
+}
+
+/**
+* Writes posted data without blocking. Returns the bytes still pending.
+*/
+int CRobot::Flush() throw (CSocketException)
+{
+   if(GetPendingOutput() == 0) return 0;
+   m_nOutgoingSent += SendRaw(m_outgoing.data() + m_nOutgoingSent,GetPendingOutput(),false);
+   if(m_nOutgoingSent == m_outgoing.size())
+   {
+      m_outgoing.clear();
+      m_nOutgoingSent = 0;
+   }
+   return GetPendingOutput();
 }
 
 /*
-* Reads data from the socket.Returns number of bytes actually read.
+* Reads data from the socket.Returns number of bytes actually read, 0 once
+* the server has closed the connection. Blocks until data is available.
+* At most len-1 bytes are returned so the data can be NUL-terminated, so
+* len must be at least 2; a smaller buffer throws CSocketException.
 * @param buffer Data buffer
-* @param len Number of bytes to read
+* @param len Size of buffer
 */
 int CRobot::Read(char* buffer,int len) throw (CSocketException)
 {
-   int nret = 0;	
-   nret = recv(m_socket,buffer,len,0);
-   if(nret == SOCKET_ERROR)
+   if(len < 2) throw CSocketException(0, "Buffer too small: Read()");
+   while(true)
+   {
+      {
+         lock_guard<mutex> lock(m_receiveLock);
+         if(m_nRingHead == m_nRingTail) Fill();
+         if(m_nRingHead != m_nRingTail || m_bPeerClosed)
+         {
+            int nret = TakeRing(buffer,len - 1);
+            buffer[nret] = '\0';
+            return nret;
+         }
+      }
+      STATS_START(start);
+      WaitReadable(-1);
+      STATS_RECORD(read,start,1);
+   }
+}
+
+/**
+* Reads one complete line without blocking. The '\n' (and a preceding '\r')
+* is removed and the line is NUL-terminated; a line longer than len-1 bytes
+* is truncated. Only one recv() is made, and only when no complete line is
+* buffered already. Returns the line length, or -1 if no complete line has
+* arrived yet. Once the server has closed the connection a final unterminated
+* line is returned as is, after which CSocketException is thrown. Once
+* RECEIVE_RING_SIZE bytes are left unread, the oldest line is discarded to
+* make room; GetDroppedLines() counts them. A buffer of less than 1 byte
+* throws CSocketException.
+* @param buffer Line buffer
+* @param len Size of buffer
+*/
+int CRobot::ReadLine(char* buffer,int len) throw (CSocketException)
+{
+   if(len < 1) throw CSocketException(0, "Buffer too small: ReadLine()");
+   lock_guard<mutex> lock(m_receiveLock);
+   int newline = FindNewline();
+   if(newline < 0)
+   {
+      Fill();
+      newline = FindNewline();
+   }
+   int lineLength = newline;
+   if(newline < 0)
    {
-      nret = WSAGetLastError();		
-      throw CSocketException(nret, "Network failure: Read()");		
+      if(!m_bPeerClosed) return -1;
+      if(m_nRingHead == m_nRingTail)
+         throw CSocketException(0, "Connection closed: ReadLine()");
+      lineLength = (int)(m_nRingHead - m_nRingTail);
    }
+
+   int nret = TakeRing(buffer,lineLength < len - 1 ? lineLength : len - 1);
+   m_nRingTail += (lineLength - nret) + (newline < 0 ? 0 : 1);
+   if(nret > 0 && buffer[nret-1] == '\r') nret--;
    buffer[nret] = '\0';
    return nret;
 }
 
+/**
+* Reads everything received so far, up to len bytes, without blocking. The
+* data is not NUL-terminated. Returns the number of bytes read, 0 if none
+* has arrived; throws CSocketException once the connection is closed and
+* nothing is left.
+* @param buffer Data buffer
+* @param len Size of buffer
+*/
+int CRobot::ReadAvailable(char* buffer,int len) throw (CSocketException)
+{
+   lock_guard<mutex> lock(m_receiveLock);
+   if((int)(m_nRingHead - m_nRingTail) < len) Fill();
+   int nret = TakeRing(buffer,len);
+   if(nret == 0 && m_bPeerClosed)
+      throw CSocketException(0, "Connection closed: ReadAvailable()");
+   return nret;
+}
+
+/**
+* Waits up to timeout ms for data from the server (0 polls, -1 waits
+* indefinitely) and buffers what arrived. Returns without waiting if data is
+* already buffered. Returns the number of bytes buffered.
+* @param timeout Time to wait in ms
+*/
+int CRobot::Poll(int timeout) throw (CSocketException)
+{
+   {
+      lock_guard<mutex> lock(m_receiveLock);
+      if(m_nRingHead == m_nRingTail) Fill();
+      if(m_nRingHead != m_nRingTail || m_bPeerClosed || timeout == 0)
+         return (int)(m_nRingHead - m_nRingTail);
+   }
+   STATS_START(start);
+   WaitReadable(timeout);
+   STATS_RECORD(read,start,1);
+   lock_guard<mutex> lock(m_receiveLock);
+   Fill();
+   return (int)(m_nRingHead - m_nRingTail);
+}
+
+bool CRobot::HasLine()
+{
+   lock_guard<mutex> lock(m_receiveLock);
+   return FindNewline() >= 0;
+}
+
+int CRobot::GetBuffered()
+{
+   lock_guard<mutex> lock(m_receiveLock);
+   return (int)(m_nRingHead - m_nRingTail);
+}
+
+/**
+* Waits up to timeout ms (-1 for ever) until the socket is readable.
+* Returns true if it is.
+* @param timeout Time to wait in ms
+*/
+bool CRobot::WaitReadable(int timeout) throw (CSocketException)
+{
+   int nret = WaitSocket(m_socket,false,timeout);
+   if(nret == SOCKET_ERROR)
+   {
+      nret = WSAGetLastError();
+      throw CSocketException(nret, "Network failure: WaitReadable()");
+   }
+   return nret > 0;
+}
+
+/**
+* Receives whatever the socket holds into the ring with a single recv(),
+* without blocking. Newlines are counted as acknowledgements for window
+* pacing. Only when the ring is full is the oldest unread line dropped,
+* and counted in m_nDroppedLines, so a client that never reads replies
+* still sees its acknowledgements; leaving the data in the socket instead
+* would stall window pacing, which waits for them.
+* A non-blocking socket is read directly, saving the readiness check.
+* The caller holds m_receiveLock. Returns the number of bytes received.
+*/
+int CRobot::Fill() throw (CSocketException)
+{
+   if(m_bPeerClosed) return 0;
+   if(!m_bNonBlocking && !WaitReadable(0)) return 0;
+
+   if(m_nRingHead == m_nRingTail)
+   {
+      m_nRingHead = m_nRingTail = 0; // an empty ring restarts at the front
+   }
+   if(m_nRingHead - m_nRingTail >= RECEIVE_RING_SIZE)
+   {
+      int newline = FindNewline();
+      if(newline < 0) m_nRingTail = m_nRingHead;
+      else m_nRingTail += newline + 1;
+      m_nDroppedLines++;
+   }
+
+   unsigned head = m_nRingHead & (RECEIVE_RING_SIZE - 1);
+   unsigned room = RECEIVE_RING_SIZE - (m_nRingHead - m_nRingTail);
+   if(room > RECEIVE_RING_SIZE - head) room = RECEIVE_RING_SIZE - head;
+   int nret = recv(m_socket,m_ring + head,room,0);
+   STATS_ADD(recvCalls,1);
+   if(nret == SOCKET_ERROR)
+   {
+      nret = WSAGetLastError();
+      if(SocketWouldBlock(nret)) return 0;
+      throw CSocketException(nret, "Network failure: Fill()");
+   }
+   if(nret == 0)
+   {
+      m_bPeerClosed = true;
+      return 0;
+   }
+
+   const char* p = m_ring + head;
+   const char* end = p + nret;
+   while((p = (const char*)memchr(p,'\n',end - p)) != NULL)
+   {
+      m_nAcksPending++;
+      p++;
+   }
+   m_nRingHead += nret;
+   STATS_ADD(bytesReceived,nret);
+   return nret;
+}
+
+/**
+* Moves up to len buffered bytes into buffer. Returns the number moved.
+*/
+int CRobot::TakeRing(char* buffer,int len)
+{
+   int used = (int)(m_nRingHead - m_nRingTail);
+   if(len > used) len = used;
+   if(len <= 0) return 0;
+   int tail = (int)(m_nRingTail & (RECEIVE_RING_SIZE - 1));
+   int first = RECEIVE_RING_SIZE - tail;
+   if(first > len) first = len;
+   memcpy(buffer,m_ring + tail,first);
+   memcpy(buffer + first,m_ring,len - first);
+   m_nRingTail += len;
+   return len;
+}
+
+/**
+* Returns the offset from the oldest buffered byte to the first '\n', or -1.
+*/
+int CRobot::FindNewline()
+{
+   int used = (int)(m_nRingHead - m_nRingTail);
+   int tail = (int)(m_nRingTail & (RECEIVE_RING_SIZE - 1));
+   int first = RECEIVE_RING_SIZE - tail;
+   if(first > used) first = used;
+   const char* p = (const char*)memchr(m_ring + tail,'\n',first);
+   if(p != NULL) return (int)(p - (m_ring + tail));
+   p = (const char*)memchr(m_ring,'\n',used - first);
+   if(p != NULL) return first + (int)(p - m_ring);
+   return -1;
+}
+
+/**
+* Selects the flow control strategy used after each command.
+* @param mode PACING_LEGACY, PACING_WINDOW, PACING_NONE or PACING_PREDICTIVE
+* @param window Max commands in flight before Send() blocks (PACING_WINDOW, PACING_PREDICTIVE)
+* @param ackTimeout ms to wait for an acknowledgement before assuming completion
+*/
+void CRobot::SetPacing(PacingMode mode,int window,int ackTimeout)
+{
+   m_pacing = mode;
+   m_nWindow = window < 1 ? 1 : window;
+   m_nAckTimeout = ackTimeout < 0 ? 0 : ackTimeout;
+   if(m_pacing != PACING_WINDOW) m_nInFlight = 0;
+   m_predicted.clear();
+   m_nBusyUntil = 0;
+   lock_guard<mutex> lock(m_receiveLock);
+   m_nAcksPending = 0;
+}
+
+/**
+* Blocks until every command in flight has been acknowledged, or in
+* predictive mode until the last one is predicted to have finished.
+*/
+void CRobot::Drain() throw (CSocketException)
+{
+   if(m_pacing == PACING_PREDICTIVE)
+   {
+      WaitPredicted(0);
+      return;
+   }
+   while(m_nInFlight > 0)
+      WaitForAck(m_nAckTimeout);
+}
+
+/**
+* Sets how far ahead of the simulator predictive pacing runs: after each
+* command, Send() returns once no more than ms of predicted work remains.
+* Larger values absorb estimates that come out short but let more
+* commands queue in the simulator's input.
+* @param ms Predicted work allowed to queue, in ms
+*/
+void CRobot::SetLookahead(int ms)
+{
+   m_nLookahead = ms < 0 ? 0 : ms;
+}
+
+/**
+* Applies flow control after commands have been written.
+* Legacy mode sleeps a fixed interval per command; window mode only blocks
+* while more than m_nWindow commands are unacknowledged; predictive mode
+* sleeps until the simulator is predicted to be within m_nLookahead ms of
+* finishing, with at most m_nWindow commands still running.
+* @param data Commands just written
+* @param len Number of bytes
+* @param commands Number of commands just written
+*/
+void CRobot::Pace(const char* data,int len,int commands) throw (CSocketException)
+{
+   if(m_pacing == PACING_LEGACY)
+   {
+      STATS_START(start);
+      Sleep(LEGACY_PACING_MS * commands);
+      STATS_RECORD(pace,start,1);
+   }
+   else if(m_pacing == PACING_WINDOW)
+   {
+      STATS_START(start);
+      m_nInFlight += commands;
+      while(m_nInFlight > m_nWindow)
+         WaitForAck(m_nAckTimeout);
+      STATS_RECORD(pace,start,1);
+   }
+   else if(m_pacing == PACING_PREDICTIVE)
+   {
+      STATS_START(start);
+      Predict(data,len);
+      WaitPredicted(m_nWindow);
+      STATS_RECORD(pace,start,1);
+   }
+   if(m_bResilient) m_journal.Trim(GetExecuted());
+}
+
+/**
+* Calibrates the motion model at one speed against a simulator that
+* acknowledges every command once it has carried it out. Sets MOTOR_SPEED
+* and times J2 moves out from its lower limit and back, growing from
+* 1/moves of its range to all of it, then fits the model to them. The arm
+* is left at J2's lower limit at that speed and the pacing is restored.
+* Returns the number of moves timed, 0 if the simulator does not
+* acknowledge within CALIBRATION_TIMEOUT.
+* @param speed MOTOR_SPEED to calibrate
+* @param moves Move lengths to time
+*/
+int CRobot::Calibrate(MotorSpeed speed,int moves) throw (CSocketException)
+{
+   PacingMode pacing = m_pacing;
+   int window = m_nWindow,ackTimeout = m_nAckTimeout;
+   SetPacing(PACING_WINDOW,1,CALIBRATION_TIMEOUT);
+
+   char buffer[MAX_COMMAND_LINE];
+   const double low = -Lab07Arm::MAX_THETA2_DEG;
+   CCommandEncoder encoder(buffer,sizeof(buffer) - 1);
+   encoder.SetMotorSpeed(speed);
+   buffer[encoder.GetLength()] = '\0';
+   Send(buffer); // one command per Send(), so each is acknowledged on its own
+   encoder.Reset();
+   encoder.RotateJoint(0,low);
+   buffer[encoder.GetLength()] = '\0';
+   Send(buffer);
+   Drain();
+
+   int timed = 0;
+   for(int i = 1; i <= moves; i++)
+   {
+      double travel = 2 * Lab07Arm::MAX_THETA2_DEG * i / moves;
+      for(int leg = 0; leg < 2; leg++)
+      {
+         encoder.Reset();
+         encoder.RotateJoint(0,leg == 0 ? low + travel : low);
+         buffer[encoder.GetLength()] = '\0';
+         uint64_t start = CRobotStats::Now();
+         Send(buffer);
+         Drain();
+         double ms = (CRobotStats::Now() - start) / 1e6;
+         if(ms >= CALIBRATION_TIMEOUT) // not acknowledged
+         {
+            i = moves;
+            break;
+         }
+         m_motion.Observe(speed,travel,ms);
+         timed++;
+      }
+   }
+   m_motion.Fit();
+   m_motion.SetPosition(0,low,speed);
+   SetPacing(pacing,window,ackTimeout);
+   return timed;
+}
+
+/**
+* Runs every command in data through the motion model and queues its
+* predicted completion: the simulator starts each command when the one
+* before it is done, or now if it is idle.
+* @param data Commands just written
+* @param len Number of bytes
+*/
+void CRobot::Predict(const char* data,int len)
+{
+   uint64_t now = CRobotStats::Now();
+   if(m_nBusyUntil < now) m_nBusyUntil = now;
+   const char* end = data + len;
+   while(data < end)
+   {
+      const char* eol = (const char*)memchr(data,'\n',end - data);
+      if(eol == NULL) eol = end;
+      if(eol > data)
+      {
+         m_nBusyUntil += (uint64_t)(m_motion.Estimate(data,(int)(eol - data)) * 1e6);
+         m_predicted.push_back(m_nBusyUntil);
+      }
+      data = eol + 1;
+   }
+   m_nInFlight = (int)m_predicted.size();
+}
+
+/**
+* Sleeps until no more than commands are predicted to be running and the
+* predicted work left is no more than m_nLookahead ms. m_nInFlight counts
+* the commands still predicted to be running.
+* @param commands Commands allowed to remain running
+*/
+void CRobot::WaitPredicted(int commands)
+{
+   const uint64_t lookahead = (uint64_t)m_nLookahead * 1000000;
+   for(;;)
+   {
+      uint64_t now = CRobotStats::Now();
+      while(!m_predicted.empty() && m_predicted.front() <= now)
+         m_predicted.pop_front();
+      m_nInFlight = (int)m_predicted.size();
+      uint64_t until = now;
+      if(m_nInFlight > commands) until = m_predicted[m_nInFlight - commands - 1];
+      if(m_nBusyUntil > until + lookahead) until = m_nBusyUntil - lookahead;
+      if(until <= now) return;
+      Sleep((unsigned long)((until - now + 999999) / 1000000));
+   }
+}
+
+/**
+* Waits up to timeout ms for the simulator to acknowledge commands. Every
+* newline received retires one command in flight; replies stay in the
+* receive ring for ReadLine(). When nothing arrives in time the oldest
+* command is assumed complete, so a simulator that never replies degrades
+* to timed pacing instead of stalling. Returns the number retired.
+* @param timeout Time to wait in ms
+*/
+int CRobot::WaitForAck(int timeout) throw (CSocketException)
+{
+   STATS_START(start);
+   int acked = 0;
+   for(int attempt = 0; attempt < 2 && acked == 0; attempt++)
+   {
+      if(attempt == 1 && !WaitReadable(timeout))
+      {
+         acked = 1;
+         break;
+      }
+      lock_guard<mutex> lock(m_receiveLock);
+      if(m_nAcksPending == 0) Fill();
+      if(m_nAcksPending == 0 && m_bPeerClosed)
+         throw CSocketException(0, "Connection closed: WaitForAck()");
+      acked = m_nAcksPending;
+      m_nAcksPending = 0;
+   }
+   if(acked > m_nInFlight) acked = m_nInFlight;
+   m_nInFlight -= acked;
+   STATS_RECORD(ack,start,1);
+   return acked;
+}
+
+/**
+* Starts the background sender thread. From then on Enqueue() returns as
+* soon as the submission is queued, and Send()/SendBatch() are routed
+* through the queue so writes never interleave.
+* @param capacity Submissions allowed in the queue before Enqueue() blocks
+*/
+void CRobot::StartAsync(int capacity)
+{
+   if(m_bAsync) return;
+   m_nQueueCapacity = capacity < 1 ? 1 : capacity;
+   m_bStopping = false;
+   m_asyncError = nullptr;
+   m_bAsync = true;
+   m_sender = thread(&CRobot::SenderLoop,this);
+}
+
+/**
+* Writes everything still queued, then stops the sender thread.
+*/
+void CRobot::StopAsync()
+{
+   if(!m_bAsync) return;
+   {
+      lock_guard<mutex> lock(m_queueLock);
+      m_bStopping = true;
+   }
+   m_queueChanged.notify_all();
+   m_sender.join();
+   m_bAsync = false;
+}
+
+/**
+* Queues commands for the sender thread. Returns immediately unless the
+* queue is full. The future yields the bytes written or rethrows the
+* CSocketException raised by the sender.
+* @param data One or more commands
+*/
+future<int> CRobot::Enqueue(const char* data)
+{
+   CAsyncCommand command;
+   command.data = data;
+   future<int> result = command.done.get_future();
+   Submit(command);
+   return result;
+}
+
+/**
+* Queues a batch for the sender thread. See Enqueue(const char*).
+* @param batch Commands to queue
+*/
+future<int> CRobot::Enqueue(CCommandBatch& batch)
+{
+   CAsyncCommand command;
+   command.data.assign(batch.GetData(),batch.GetLength());
+   future<int> result = command.done.get_future();
+   Submit(command);
+   return result;
+}
+
+/**
+* Queues commands for the sender thread and reports completion through
+* callback, which runs on the sender thread.
+* @param data One or more commands
+* @param callback Called with bytes written, or with the failure
+*/
+void CRobot::Enqueue(const char* data,SendCallback callback)
+{
+   CAsyncCommand command;
+   command.data = data;
+   command.callback = callback;
+   Submit(command);
+}
+
+/**
+* Blocks until the queue is empty and the sender has finished writing.
+*/
+void CRobot::WaitIdle()
+{
+   unique_lock<mutex> lock(m_queueLock);
+   while(!m_queue.empty() || m_nQueueBusy > 0)
+      m_queueChanged.wait(lock);
+}
+
+/**
+* Turns resilient mode on or off. While on, every command written is kept
+* in a replay journal back to the last checkpoint (HOME or PEN_UP), and a
+* failed write or acknowledgement reconnects to the same host and resumes
+* the job instead of throwing. Turn it on before the job starts. Use it
+* with PACING_WINDOW: only acknowledged commands are known to have run,
+* and without acknowledgements a replay can only go back to the newest
+* checkpoint written, which may itself have been lost with the connection.
+* @param on true to journal and reconnect
+* @param attempts Reconnects tried per failure before giving up, -1 for no limit
+*/
+void CRobot::SetResilient(bool on,int attempts)
+{
+   if(on && !m_bResilient)
+   {
+      m_journal.Clear();
+      m_nWritten = m_nReplayFrom = m_journal.GetNext();
+   }
+   m_bResilient = on;
+   m_nMaxReconnects = attempts;
+}
+
+/**
+* Returns the journal sequence number below which every entry is known to
+* have been executed. Only window mode gets acknowledgements; predictive
+* mode counts what the motion model says has finished, and otherwise
+* everything written counts, so the journal is trimmed at the newest
+* checkpoint written and a replay starts from there.
+*/
+long CRobot::GetExecuted()
+{
+   if(m_pacing != PACING_WINDOW && m_pacing != PACING_PREDICTIVE) return m_nWritten;
+   // Commands in flight are the newest written; any beyond the entries
+   // resent by the last Replay() belong to its restore prelude
+   long executed = m_nWritten - m_nInFlight;
+   if(executed < m_nReplayFrom) executed = m_nReplayFrom;
+   return executed < m_journal.GetFirst() ? m_journal.GetFirst() : executed;
+}
+
+/**
+* Recovers from a failed write or acknowledgement in resilient mode.
+* Reconnects to the host of the last Connect(), at once and then with
+* exponential backoff from RECONNECT_INITIAL_DELAY to RECONNECT_MAX_DELAY
+* ms, and replays the journal from the last acknowledged command (window
+* mode) or the last checkpoint. Throws when the attempts run out.
+*/
+void CRobot::Recover() throw (CSocketException)
+{
+   long from = m_pacing == PACING_WINDOW ? GetExecuted() : m_journal.GetFirst();
+   int delay = RECONNECT_INITIAL_DELAY;
+   for(int attempt = 0; m_nMaxReconnects < 0 || attempt < m_nMaxReconnects; attempt++)
+   {
+      if(attempt > 0)
+      {
+         Sleep(delay);
+         delay = delay * 2 > RECONNECT_MAX_DELAY ? RECONNECT_MAX_DELAY : delay * 2;
+      }
+      if(m_socket != INVALID_SOCKET) closesocket(m_socket);
+      m_socket = INVALID_SOCKET;
+      m_outgoing.clear();
+      m_nOutgoingSent = 0;
+      m_nInFlight = 0;
+      m_predicted.clear();
+      m_nBusyUntil = 0;
+      m_motion.Forget(); // wherever the arm stopped, the restore moves it from there
+      if(!Connect(m_strHost.c_str(),m_nPort)) continue;
+      m_nReconnects++;
+      try
+      {
+         Replay(from);
+         return;
+      }
+      catch(CSocketException&)
+      {
+      }
+   }
+   throw CSocketException(0, "Reconnect failed: Recover()");
+}
+
+/**
+* Brings the simulator back to the state just before journal entry from -
+* pen up, back to that position, colour and speed restored, pen down if it
+* was - and resends every entry from there on.
+* @param from Sequence number of the first entry to resend
+*/
+void CRobot::Replay(long from) throw (CSocketException)
+{
+   if(from < m_journal.GetFirst()) from = m_journal.GetFirst();
+   char restore[REPLAY_RESTORE_MAX];
+   int len = m_journal.GetState(from).Restore(restore,sizeof(restore));
+   int commands = 0;
+   for(int i = 0; i < len; i++)
+      if(restore[i] == '\n') commands++;
+   m_nWritten = m_nReplayFrom = from;
+   SendAll(restore,len);
+   Pace(restore,len,commands);
+   for(long seq = from; seq < m_journal.GetNext(); seq++)
+   {
+      const string& text = m_journal.Get(seq);
+      SendAll(text.data(),(int)text.size());
+      m_nWritten = seq + 1;
+      Pace(text.data(),(int)text.size(),1);
+   }
+}
+
+bool CRobot::IsStatsEnabled()
+{
+#ifdef SCARA_STATS
+   return true;
+#else
+   return false;
+#endif
+}
+
+/**
+* Copies the instrumentation counters and histograms into out. Safe to
+* call from any thread while commands are being sent. Returns false, and
+* leaves out untouched, if the library was built without SCARA_STATS.
+* @param out Receives the snapshot
+*/
+bool CRobot::GetStats(CRobotStats* out)
+{
+   if(m_stats == NULL) return false;
+   m_stats->Snapshot(out);
+   return true;
+}
+
+/**
+* Zeroes the counters. Call it while nothing is being sent or read.
+*/
+void CRobot::ResetStats()
+{
+   if(m_stats != NULL) m_stats->Reset();
+   m_nStatsStart = m_nStatsDumped = CRobotStats::Now();
+}
+
+/**
+* Prints the statistics (see CRobotStats::Print()) every interval ms. The
+* check runs after each Send()/SendBatch() on the sending thread, so an
+* idle connection prints nothing. Has no effect without SCARA_STATS.
+* @param out Destination, e.g. stderr, or NULL to stop
+* @param interval Time between dumps in ms
+*/
+void CRobot::SetStatsDump(FILE* out,int interval)
+{
+   m_statsOut = m_stats != NULL ? out : NULL;
+   m_nStatsInterval = interval < 0 ? 0 : interval;
+   m_nStatsDumped = CRobotStats::Now();
+}
+
+void CRobot::DumpStats()
+{
+   uint64_t now = CRobotStats::Now();
+   if(now - m_nStatsDumped < (uint64_t)m_nStatsInterval * 1000000) return;
+   m_nStatsDumped = now;
+   m_stats->Print(m_statsOut,(now - m_nStatsStart) / 1e9);
+   fflush(m_statsOut);
+}
+
+/**
+* Moves a submission onto the queue, waiting for room if it is full.
+* Without a sender thread the submission is written immediately.
+* @param command Submission to queue
+*/
+void CRobot::Submit(CAsyncCommand& command)
+{
+   if(!m_bAsync)
+   {
+      CCommandBatch batch;
+      batch.Add(command.data.c_str(),(int)command.data.size());
+      try
+      {
+         int written = WriteBatch(batch);
+         command.done.set_value(written);
+         if(command.callback) command.callback(written,NULL);
+      }
+      catch(CSocketException& e)
+      {
+         command.done.set_exception(current_exception());
+         if(command.callback) command.callback(0,&e);
+      }
+      return;
+   }
+   unique_lock<mutex> lock(m_queueLock);
+   while((int)m_queue.size() >= m_nQueueCapacity)
+      m_queueChanged.wait(lock);
+   m_queue.push_back(move(command));
+   lock.unlock();
+   m_queueChanged.notify_all();
+}
+
+/**
+* Sender thread. Takes everything queued so far, writes it as one batch
+* and completes each submission, until StopAsync() is called and the queue
+* has been flushed. When a write fails, the submissions written in full
+* before it still complete normally and the rest get the exception; from
+* then on every submission fails with it at once instead of being written
+* to the dead connection.
+*/
+void CRobot::SenderLoop()
+{
+   deque<CAsyncCommand> pending;
+   vector<int> ends; // commands in the batch up to and including each submission
+   CCommandBatch batch;
+
+   while(true)
+   {
+      {
+         unique_lock<mutex> lock(m_queueLock);
+         while(m_queue.empty() && !m_bStopping)
+            m_queueChanged.wait(lock);
+         if(m_queue.empty()) return;
+         pending.swap(m_queue);
+         m_nQueueBusy = (int)pending.size();
+      }
+      m_queueChanged.notify_all();
+
+      batch.Clear();
+      ends.clear();
+      for(size_t i = 0; i < pending.size(); i++)
+      {
+         batch.Add(pending[i].data.c_str(),(int)pending[i].data.size());
+         ends.push_back(batch.GetCount());
+      }
+      int written = 0;
+      try
+      {
+         if(m_asyncError) rethrow_exception(m_asyncError);
+         WriteBatch(batch,&written);
+      }
+      catch(CSocketException&)
+      {
+         if(!m_asyncError) m_asyncError = current_exception();
+      }
+      for(size_t i = 0; i < pending.size(); i++)
+      {
+         if(ends[i] <= written)
+         {
+            int bytes = (int)pending[i].data.size();
+            pending[i].done.set_value(bytes);
+            if(pending[i].callback) pending[i].callback(bytes,NULL);
+            continue;
+         }
+         pending[i].done.set_exception(m_asyncError);
+         if(pending[i].callback)
+         {
+            try
+            {
+               rethrow_exception(m_asyncError);
+            }
+            catch(CSocketException& e)
+            {
+               pending[i].callback(0,&e);
+            }
+         }
+      }
+      pending.clear();
+
+      {
+         lock_guard<mutex> lock(m_queueLock);
+         m_nQueueBusy = 0;
+      }
+      m_queueChanged.notify_all();
+   }
+}
+
 void CRobot::Close()
 {
+   StopAsync();
+   if(m_socket == INVALID_SOCKET) return;
    closesocket(m_socket);
+   m_socket = INVALID_SOCKET;
    if(m_clientAddr != NULL) delete m_clientAddr;
+   m_clientAddr = NULL;
    CWinSock::Finalize();
 }
 
 int CRobot::Initialize()
 {
    int nret;                  // for integer return values
-   system("cls");
+   system(CLEAR_SCREEN);
    printf("Connecting to %s through port %d...\n",IPV4_STRING,PORT);
 
    // initializes winsock
@@ -299,6 +1519,51 @@ int CRobot::Initialize()
 CRobot::~CRobot() 
 {
    Close();
+   delete m_stats;
+}
+
+// CCommandBatch
+
+CCommandBatch::CCommandBatch()
+{
+}
+
+/**
+* Appends one or more commands. Text is split on '\n', blank lines are
+* dropped and a terminating '\n' is added to the last command if missing,
+* so adjacent commands can never run together on the wire.
+* @param command NUL-terminated command text
+*/
+void CCommandBatch::Add(const char* command)
+{
+   Add(command,strlen(command));
+}
+
+/**
+* Appends len bytes of command text. See Add(const char*).
+* @param command Command text
+* @param len Number of bytes
+*/
+void CCommandBatch::Add(const char* command,int len)
+{
+   int lineStart = 0;
+   for(int i = 0; i <= len; i++)
+   {
+      if(i < len && command[i] != '\n') continue;
+      if(i > lineStart)
+      {
+         m_buffer.append(command + lineStart,i - lineStart);
+         m_buffer.push_back('\n');
+         m_ends.push_back((int)m_buffer.size());
+      }
+      lineStart = i + 1;
+   }
+}
+
+void CCommandBatch::Clear()
+{
+   m_buffer.clear();
+   m_ends.clear();
 }
 
 // CSocketAddress
@@ -318,7 +1583,7 @@ CSocketAddress::CSocketAddress(SOCKADDR_IN sockAddr)
    m_sockAddrIn.sin_addr.s_addr = sockAddr.sin_addr.s_addr;
    m_sockAddrIn.sin_port = sockAddr.sin_port;
    m_strHostName = inet_ntoa(m_sockAddrIn.sin_addr);
-   m_nPort = sockAddr.sin_port;;
+   m_nPort = ntohs(sockAddr.sin_port);
 }
 
 const char* CSocketAddress::GetIP()
@@ -326,53 +1591,58 @@ const char* CSocketAddress::GetIP()
    return (const char*)inet_ntoa(m_sockAddrIn.sin_addr);
 }
 
+/**
+* Returns the official name of the host, from the resolver cache. Returns
+* NULL if the host cannot be resolved.
+*/
 const char* CSocketAddress::GetName() 
 {
-   HOSTENT *lpHost = gethostbyname(GetIP());
-   if(lpHost == NULL) return NULL;
-   return lpHost->h_name;
+   HostEntryPtr host = CResolver::Instance().Resolve(m_strHostName.c_str());
+   if(host->error != 0) return NULL;
+   m_strName = host->name;
+   return m_strName.c_str();
 }
 
 void CSocketAddress::GetAliases(vector<string>* ret) 
 {
-   HOSTENT *lpHost = gethostbyname(GetIP());
-   if(lpHost == NULL) return;
-   char** tmp = (char**)lpHost->h_aliases;	
-   if(tmp == NULL) 
-      return;
-   else 
-   {
-      int i = 0;
-      while(true) 
-      {
-         if(tmp[i] == NULL) break;
-         else ret->push_back(tmp[i]);
-      }
-   }
+   HostEntryPtr host = CResolver::Instance().Resolve(m_strHostName.c_str());
+   for(size_t i = 0; i < host->aliases.size(); i++)
+      ret->push_back(host->aliases[i]);
 }
 
 /**
-* Returns the sockaddr_in. tries to bind with the server.
+* Returns the sockaddr_in. tries to bind with the server. The host is
+* resolved once and then served from the resolver cache.
 * throws CSocketException on failure.
 */
 SOCKADDR_IN CSocketAddress::GetSockAddrIn() throw (CSocketException) 
 {
-   m_lpHostEnt = gethostbyname(m_strHostName.c_str());
-   if (!m_lpHostEnt) 
+   HostEntryPtr host = CResolver::Instance().Resolve(m_strHostName.c_str());
+   const SOCKADDR_IN* ipv4 = host->FindIPv4();
+   if (ipv4 == NULL) 
    {
-      int nret = WSAGetLastError();
-      throw CSocketException(nret, "Failed to resolve host:gethostbyname()");
+      int nret = host->error != 0 ? host->error : EAI_NONAME;
+      throw CSocketException(nret, "Failed to resolve host: GetSockAddrIn()");
    }
-   m_sockAddrIn.sin_addr = *((LPIN_ADDR)*m_lpHostEnt->h_addr_list);
+   m_sockAddrIn.sin_addr = ipv4->sin_addr;
    return m_sockAddrIn;
 }
 
+/**
+* Starts resolving the host on the resolver's worker thread, so a later
+* GetSockAddrIn() or connect finds it cached.
+*/
+void CSocketAddress::Prefetch()
+{
+   CResolver::Instance().ResolveAsync(m_strHostName.c_str());
+}
+
 void CSocketAddress::operator = (CSocketAddress addr) 
 {
    m_sockAddrIn = addr.m_sockAddrIn;
    m_strHostName = addr.m_strHostName;
+   m_strName = addr.m_strName;
    m_nPort = addr.m_nPort;
-   m_lpHostEnt = addr.m_lpHostEnt;
 }
 
 CSocketAddress::~CSocketAddress() 
@@ -5,21 +5,58 @@
 #include <string>
 using namespace std;
 #include <vector>
-#include <windows.h>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include "socket_platform.h"
+#include "replay_journal.h"
+#include "robot_stats.h"
+#include "motion_model.h"
 
 #define PORT         1270
 #define IPV4_STRING  "127.0.0.1"
 
-#pragma warning (disable : 4996)
-#pragma warning (disable : 4290)
-#pragma comment(lib,"wsock32")
+#define LEGACY_PACING_MS     200  /// fixed delay applied after every command in legacy mode
+#define DEFAULT_ACK_WINDOW   4    /// commands allowed in flight in window mode
+#define DEFAULT_ACK_TIMEOUT  200  /// ms to wait for an acknowledgement before assuming completion
+#define DEFAULT_ASYNC_QUEUE  1024 /// queued submissions allowed before Enqueue() blocks
+#define RECEIVE_RING_SIZE    16384 /// bytes buffered from the socket (power of two)
+#define DEFAULT_CONNECT_TIMEOUT  2000 /// ms Connect() waits for the host to resolve and answer
+#define CONNECT_ATTEMPT_DELAY    250  /// ms before the next address is tried alongside a slow one
+#define DEFAULT_RECONNECT_ATTEMPTS  10   /// reconnects tried per failure in resilient mode, -1 for no limit
+#define RECONNECT_INITIAL_DELAY     100  /// ms before the second reconnect attempt, doubled after each
+#define RECONNECT_MAX_DELAY         5000 /// ms the reconnect backoff grows to
+#define DEFAULT_LOOKAHEAD       50   /// ms of predicted work kept queued in the simulator (PACING_PREDICTIVE)
+#define CALIBRATION_MOVES       8    /// moves timed per speed by Calibrate()
+#define CALIBRATION_TIMEOUT     5000 /// ms Calibrate() waits for a move to be acknowledged
 
 namespace openutils 
 {
 
    class CRobot;
-   class CSocketException;
+   class CCommandBatch;
+   class CUringWriter;
    class CSocketAddress;
+   struct CHostEntry;
+
+   class CSocketException 
+   {
+   private:
+      string m_strError; /// error message
+      int m_nCode; /// Error code
+   public:
+      CSocketException(int code,const char* msg) 
+      {
+         m_nCode = code;
+         m_strError = msg;
+      }
+      
+      inline int GetCode() { return m_nCode; }
+      inline const char* GetMessage() { return m_strError.c_str(); }
+   };
 
    class CWinSock {
    public:
@@ -42,7 +79,9 @@ namespace openutils
       CServerSocket(int port,int queue); /// overloaded constructor
       ~CServerSocket(); /// default destructor
       void Bind(CSocketAddress *scok_addr);/// Binds the server to the given address.
+      void Listen() throw (CSocketException);/// Binds and starts listening without accepting.
       CRobot* Accept() throw (CSocketException);/// Accepts a client connection.
+      SOCKET GetSocket() { return m_socket; } /// Returns the listening SOCKET
       void Close(); /// Closes the Socket.	
       bool IsListening(); /// returns the listening flag
 
@@ -55,59 +94,182 @@ namespace openutils
       void Init(); /// default initialization
    };
 
+   /// Flow control applied by CRobot after commands are written.
+   enum PacingMode
+   {
+      PACING_LEGACY, /// sleep LEGACY_PACING_MS after every command (original behaviour)
+      PACING_WINDOW, /// keep at most N unacknowledged commands in flight
+      PACING_NONE,   /// no flow control, for servers and raw streaming
+      PACING_PREDICTIVE /// wait only as long as the motion model predicts the simulator needs
+   };
+
+   class CCommandBatch
+   {
+   private:
+      string m_buffer; /// commands stored back to back, each ending in '\n'
+      vector<int> m_ends; /// offset just past the '\n' of each command
+   public:
+      CCommandBatch(); /// Default constructor
+      void Add(const char* command); /// Appends one or more commands
+      void Add(const char* command,int len); /// Appends len bytes of commands
+      void Clear(); /// Removes all commands
+      int GetCount() { return (int)m_ends.size(); } /// Returns the number of commands
+      int GetLength() { return (int)m_buffer.size(); } /// Returns the size in bytes
+      const char* GetData() { return m_buffer.data(); } /// Returns the contiguous command buffer
+      int GetStart(int index) { return index == 0 ? 0 : m_ends[index-1]; } /// Offset of a command
+      int GetEnd(int index) { return m_ends[index]; } /// Offset just past a command's '\n'
+      const int* GetEnds() { return m_ends.data(); } /// Offsets just past every command's '\n'
+   };
+
+   /// Completion callback for asynchronous sends: bytes written, or the failure (NULL on success).
+   typedef function<void(int written,const CSocketException* error)> SendCallback;
+
    class CRobot 
    {
+      friend class CUringWriter; /// writes through SendAll() when io_uring is unavailable
    private:
+      struct CAsyncCommand
+      {
+         string data; /// one or more newline-terminated commands
+         promise<int> done; /// fulfilled with bytes written
+         SendCallback callback; /// optional completion callback
+      };
+
       SOCKET m_socket; /// SOCKET for communication
       CSocketAddress *m_clientAddr; /// Address details of this socket.
+      PacingMode m_pacing; /// flow control strategy
+      int m_nWindow; /// max commands in flight (PACING_WINDOW)
+      int m_nAckTimeout; /// ms to wait for an acknowledgement (PACING_WINDOW)
+      int m_nInFlight; /// commands written but not yet acknowledged
+      thread m_sender; /// background sender thread (async mode)
+      mutex m_queueLock; /// guards the async queue
+      condition_variable m_queueChanged; /// signalled when the async queue changes
+      deque<CAsyncCommand> m_queue; /// submissions waiting for the sender thread
+      int m_nQueueCapacity; /// max submissions queued before Enqueue() blocks
+      int m_nQueueBusy; /// submissions taken by the sender but not yet completed
+      bool m_bAsync; /// true while the sender thread runs
+      bool m_bStopping; /// asks the sender thread to exit once the queue is empty
+      exception_ptr m_asyncError; /// first failure of the sender thread; later submissions fail with it
+      char m_ring[RECEIVE_RING_SIZE]; /// received bytes not yet read
+      unsigned m_nRingHead; /// total bytes written into m_ring
+      unsigned m_nRingTail; /// total bytes read out of m_ring
+      int m_nAcksPending; /// newlines received but not yet credited to the window
+      long m_nDroppedLines; /// unread lines discarded to make room in the receive ring
+      bool m_bPeerClosed; /// the server closed its side of the connection
+      mutex m_receiveLock; /// guards the receive ring
+      bool m_bNonBlocking; /// socket is in non-blocking mode (event loop)
+      string m_outgoing; /// bytes posted but not yet accepted by the socket
+      size_t m_nOutgoingSent; /// bytes of m_outgoing already written
+      string m_strHost; /// host of the last Connect(), for reconnecting
+      int m_nPort; /// port of the last Connect()
+      bool m_bResilient; /// journal commands and reconnect on failure
+      int m_nMaxReconnects; /// reconnects tried per failure, -1 for no limit
+      int m_nReconnects; /// successful reconnects so far
+      CReplayJournal m_journal; /// commands since the last checkpoint (resilient mode)
+      long m_nWritten; /// journal sequence number just past the last entry written
+      long m_nReplayFrom; /// first entry resent by the last Replay(); everything before it had executed
+      CRobotStats* m_stats; /// instrumentation, NULL unless built with SCARA_STATS
+      FILE* m_statsOut; /// where DumpStats() writes, NULL for no periodic dump
+      int m_nStatsInterval; /// ms between periodic dumps
+      uint64_t m_nStatsStart; /// when the statistics were last reset, in ns
+      uint64_t m_nStatsDumped; /// when they were last dumped, in ns
+      CMotionModel m_motion; /// command durations (PACING_PREDICTIVE)
+      deque<uint64_t> m_predicted; /// predicted completion of each command still running, in ns
+      uint64_t m_nBusyUntil; /// predicted completion of the last command written, in ns
+      int m_nLookahead; /// ms of predicted work allowed to queue (PACING_PREDICTIVE)
    public:
       CRobot(); /// Default constructor
       void SetSocket(SOCKET sock); /// Sets the SOCKET
       void SetClientAddr(SOCKADDR_IN addr); /// Sets address details
       int Connect(); /// Connects to a server
-      int Connect(const char* host_name,int port); /// Connects to host
+      int Connect(const char* host_name,int port,int timeout = DEFAULT_CONNECT_TIMEOUT); /// Connects to host within timeout ms
       CSocketAddress* GetAddress() { return m_clientAddr; } /// Returns the client address
       int Send(const char* data) throw (CSocketException); /// Writes data to the socket
+      int SendBatch(CCommandBatch& batch) throw (CSocketException); /// Writes a batch with one send per window
+      int SendCommands(const char* data,const int* ends,int first,int last) throw (CSocketException); /// Writes pre-split commands in place, e.g. from a mapped job
+      SOCKET GetSocket() { return m_socket; } /// Returns the SOCKET, e.g. for select()
       int Read(char* buffer,int len) throw (CSocketException); /// Reads data from the socket
+      int ReadLine(char* buffer,int len) throw (CSocketException); /// Reads one complete line without blocking
+      int ReadAvailable(char* buffer,int len) throw (CSocketException); /// Reads whatever has arrived without blocking
+      int Poll(int timeout) throw (CSocketException); /// Waits for data, returns bytes buffered
+      bool HasLine(); /// True if a complete line is buffered
+      int GetBuffered(); /// Returns the number of bytes buffered
+      long GetDroppedLines() { return m_nDroppedLines; } /// Returns the unread lines discarded because the receive ring filled
+      bool IsPeerClosed() { return m_bPeerClosed; } /// True once the server closed the connection
+      void SetNonBlocking(bool on); /// Puts the socket in non-blocking mode for an event loop
+      bool IsNonBlocking() { return m_bNonBlocking; } /// Returns the socket mode
+      int Post(const char* data,int len) throw (CSocketException); /// Writes what fits now, keeps the rest for Flush()
+      int Flush() throw (CSocketException); /// Writes posted data without blocking, returns bytes still pending
+      int GetPendingOutput() { return (int)(m_outgoing.size() - m_nOutgoingSent); } /// Bytes posted but not yet written
+      void SetPacing(PacingMode mode,int window = DEFAULT_ACK_WINDOW,int ackTimeout = DEFAULT_ACK_TIMEOUT); /// Selects the flow control strategy
+      PacingMode GetPacing() { return m_pacing; } /// Returns the flow control strategy
+      int GetInFlight() { return m_nInFlight; } /// Returns the number of unacknowledged commands
+      void Drain() throw (CSocketException); /// Waits until every command in flight is acknowledged
+      void SetLookahead(int ms); /// Sets the ms of predicted work kept queued (PACING_PREDICTIVE)
+      int GetLookahead() { return m_nLookahead; } /// Returns the ms of predicted work kept queued
+      CMotionModel& GetMotionModel() { return m_motion; } /// Returns the model PACING_PREDICTIVE runs on
+      int Calibrate(MotorSpeed speed,int moves = CALIBRATION_MOVES) throw (CSocketException); /// Times moves at speed and fits the motion model
+      void StartAsync(int capacity = DEFAULT_ASYNC_QUEUE); /// Starts the background sender thread
+      void StopAsync(); /// Flushes the queue and stops the sender thread
+      bool IsAsync() { return m_bAsync; } /// Returns true while the sender thread runs
+      future<int> Enqueue(const char* data); /// Queues commands for the sender thread
+      future<int> Enqueue(CCommandBatch& batch); /// Queues a batch for the sender thread
+      void Enqueue(const char* data,SendCallback callback); /// Queues commands, reports through callback
+      void WaitIdle(); /// Blocks until every queued submission has been written
+      void SetResilient(bool on,int attempts = DEFAULT_RECONNECT_ATTEMPTS); /// Journals commands and reconnects on failure
+      bool IsResilient() { return m_bResilient; } /// Returns true in resilient mode
+      int GetReconnectCount() { return m_nReconnects; } /// Returns the reconnects made so far
+      int GetJournalCount() { return m_journal.GetCount(); } /// Returns the commands kept for replay
+      bool GetStats(CRobotStats* out); /// Copies the instrumentation counters, false if not built in
+      void ResetStats(); /// Zeroes the instrumentation counters
+      void SetStatsDump(FILE* out,int interval); /// Prints the statistics to out every interval ms, NULL to stop
+      static bool IsStatsEnabled(); /// True if built with SCARA_STATS
       void Close(); /// Closes the socket
       int Initialize();
       ~CRobot(); /// Destructor
+   private:
+      static SOCKET ConnectAny(const CHostEntry& host,int port,int timeout); /// Races connects to every address of host
+      int SendAll(const char* data,int len) throw (CSocketException); /// Writes len bytes to the socket
+      int SendRaw(const char* data,int len,bool wait) throw (CSocketException); /// Writes until done, or until the socket would block
+      int WriteBatch(CCommandBatch& batch,int* written = NULL) throw (CSocketException); /// Writes a batch on the calling thread
+      int WriteCommands(const char* data,const int* ends,int first,int count,int* written = NULL) throw (CSocketException); /// Writes pre-split commands on the calling thread
+      void Submit(CAsyncCommand& command); /// Moves a submission onto the async queue
+      void SenderLoop(); /// Body of the sender thread
+      bool IsSenderThread() { return m_bAsync && this_thread::get_id() == m_sender.get_id(); }
+      void Pace(const char* data,int len,int commands) throw (CSocketException); /// Applies flow control after commands are written
+      void Predict(const char* data,int len); /// Adds the predicted completion of each command written
+      void WaitPredicted(int commands); /// Sleeps until no more than commands are predicted running and the backlog fits the lookahead
+      int WaitForAck(int timeout) throw (CSocketException); /// Consumes acknowledgements, returns the number received
+      bool WaitReadable(int timeout) throw (CSocketException); /// Waits until the socket is readable
+      int Fill() throw (CSocketException); /// Receives into the ring without blocking, returns bytes received
+      int TakeRing(char* buffer,int len); /// Moves up to len buffered bytes into buffer
+      int FindNewline(); /// Offset of the first buffered '\n', or -1
+      long GetExecuted(); /// Journal sequence number below which every entry is known executed
+      void Recover() throw (CSocketException); /// Reconnects and replays the journal
+      void Replay(long from) throw (CSocketException); /// Restores the state at entry from and resends from there
+      void DumpStats(); /// Prints the statistics if the dump interval has passed
    };
 
    class CSocketAddress 
    {
    private:
       SOCKADDR_IN m_sockAddrIn; /// server info
-      LPHOSTENT m_lpHostEnt; /// used to obtain address by name
       string m_strHostName; /// host name
+      string m_strName; /// official name, filled by GetName()
       int m_nPort; /// port 
    public:
       CSocketAddress(const char* host,int port); /// default constructor		
       CSocketAddress(SOCKADDR_IN sockAddr);/// Constructor initialized by a SOCKADDR_IN
       const char* GetIP(); /// Returns the IP address
+      const char* GetHostName() { return m_strHostName.c_str(); } /// Returns the name or address given
       const char* GetName(); /// Returns the official address
       int GetPort() { return m_nPort; } /// Returns the port
       void GetAliases(vector<string>* ret); /// Returns aliases
       SOCKADDR_IN GetSockAddrIn() throw (CSocketException); /// returns the sockaddr_in
+      void Prefetch(); /// Starts resolving the host in the background
       void operator = (CSocketAddress addr); /// Assignment operation
       ~CSocketAddress(); /// Destructor
    };
-
-   class CSocketException 
-   {
-   private:
-      string m_strError; /// error message
-      int m_nCode; /// Error code
-   public:
-      CSocketException(int code,const char* msg) 
-      {
-         m_nCode = code;
-         m_strError = msg;
-      }
-      
-      inline int GetCode() { return m_nCode; }
-      inline const char* GetMessage() { return m_strError.c_str(); }
-   };
 }
 
 using namespace openutils;
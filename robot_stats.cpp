@@ -0,0 +1,182 @@
+#include <chrono>
+#include "robot_stats.h"
+using namespace openutils;
+
+#define RELAXED std::memory_order_relaxed
+
+/// Index of the highest set bit; v must not be 0.
+static int highestBit(uint64_t v)
+{
+#if defined(__GNUC__)
+   return 63 - __builtin_clzll(v);
+#else
+   int bit = 0;
+   while(v >>= 1) bit++;
+   return bit;
+#endif
+}
+
+CLatencyHistogram::CLatencyHistogram()
+{
+   Reset();
+}
+
+void CLatencyHistogram::Reset()
+{
+   for(int i = 0; i < HISTOGRAM_BUCKETS; i++)
+      m_counts[i].store(0,RELAXED);
+   m_nCount.store(0,RELAXED);
+   m_nSum.store(0,RELAXED);
+   m_nMax.store(0,RELAXED);
+}
+
+/**
+* Values below 2^HISTOGRAM_SUB_BITS get a bucket each. Above that, the
+* power of two selects a group and the HISTOGRAM_SUB_BITS bits below the
+* top one select the bucket inside it. Values past HISTOGRAM_MAX_BITS
+* share the last bucket.
+*/
+int CLatencyHistogram::GetBucket(uint64_t ns)
+{
+   if(ns < (1u << HISTOGRAM_SUB_BITS)) return (int)ns;
+   int shift = highestBit(ns) - HISTOGRAM_SUB_BITS;
+   int bucket = ((shift + 1) << HISTOGRAM_SUB_BITS) + (int)((ns >> shift) - (1u << HISTOGRAM_SUB_BITS));
+   return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+uint64_t CLatencyHistogram::GetBucketTop(int bucket)
+{
+   int group = bucket >> HISTOGRAM_SUB_BITS;
+   uint64_t sub = bucket & ((1u << HISTOGRAM_SUB_BITS) - 1);
+   if(group == 0) return sub;
+   return ((((uint64_t)1 << HISTOGRAM_SUB_BITS) + sub + 1) << (group - 1)) - 1;
+}
+
+/**
+* Adds count occurrences of a value. Only one thread may record into a
+* histogram; the updates are plain relaxed stores, not atomic adds.
+* @param ns Value in nanoseconds
+* @param count Number of occurrences
+*/
+void CLatencyHistogram::Record(uint64_t ns,uint64_t count)
+{
+   std::atomic<uint64_t>& bucket = m_counts[GetBucket(ns)];
+   bucket.store(bucket.load(RELAXED) + count,RELAXED);
+   m_nCount.store(m_nCount.load(RELAXED) + count,RELAXED);
+   m_nSum.store(m_nSum.load(RELAXED) + ns * count,RELAXED);
+   if(ns > m_nMax.load(RELAXED)) m_nMax.store(ns,RELAXED);
+}
+
+void CLatencyHistogram::Snapshot(CLatencyHistogram* out) const
+{
+   uint64_t count = 0;
+   for(int i = 0; i < HISTOGRAM_BUCKETS; i++)
+   {
+      uint64_t n = m_counts[i].load(RELAXED);
+      out->m_counts[i].store(n,RELAXED);
+      count += n;
+   }
+   out->m_nCount.store(count,RELAXED); // consistent with the buckets copied
+   out->m_nSum.store(m_nSum.load(RELAXED),RELAXED);
+   out->m_nMax.store(m_nMax.load(RELAXED),RELAXED);
+}
+
+double CLatencyHistogram::GetMean() const
+{
+   uint64_t count = GetCount();
+   return count == 0 ? 0 : (double)GetSum() / count;
+}
+
+/**
+* Returns the value below which percent of the recorded values fall, to
+* the precision of a bucket (never more than the largest value recorded).
+* @param percent 0..100
+*/
+uint64_t CLatencyHistogram::GetPercentile(double percent) const
+{
+   uint64_t count = GetCount();
+   if(count == 0) return 0;
+   uint64_t rank = (uint64_t)(percent / 100.0 * count + 0.5);
+   if(rank < 1) rank = 1;
+   if(rank > count) rank = count;
+   uint64_t seen = 0;
+   for(int i = 0; i < HISTOGRAM_BUCKETS; i++)
+   {
+      seen += m_counts[i].load(RELAXED);
+      if(seen >= rank)
+      {
+         uint64_t top = GetBucketTop(i);
+         return top < GetMax() ? top : GetMax();
+      }
+   }
+   return GetMax();
+}
+
+CRobotStats::CRobotStats()
+{
+   Reset();
+}
+
+void CRobotStats::Reset()
+{
+   commands.store(0,RELAXED);
+   bytesSent.store(0,RELAXED);
+   sendCalls.store(0,RELAXED);
+   sendWaits.store(0,RELAXED);
+   bytesReceived.store(0,RELAXED);
+   recvCalls.store(0,RELAXED);
+   command.Reset();
+   send.Reset();
+   pace.Reset();
+   ack.Reset();
+   read.Reset();
+}
+
+void CRobotStats::Snapshot(CRobotStats* out) const
+{
+   out->commands.store(commands.load(RELAXED),RELAXED);
+   out->bytesSent.store(bytesSent.load(RELAXED),RELAXED);
+   out->sendCalls.store(sendCalls.load(RELAXED),RELAXED);
+   out->sendWaits.store(sendWaits.load(RELAXED),RELAXED);
+   out->bytesReceived.store(bytesReceived.load(RELAXED),RELAXED);
+   out->recvCalls.store(recvCalls.load(RELAXED),RELAXED);
+   command.Snapshot(&out->command);
+   send.Snapshot(&out->send);
+   pace.Snapshot(&out->pace);
+   ack.Snapshot(&out->ack);
+   read.Snapshot(&out->read);
+}
+
+uint64_t CRobotStats::Now()
+{
+   return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+* Writes the counters and a percentile table (microseconds) to out.
+* @param out Destination, e.g. stderr
+* @param seconds Time the values cover, > 0 to print rates
+*/
+void CRobotStats::Print(FILE* out,double seconds) const
+{
+   uint64_t nCommands = commands.load(RELAXED);
+   fprintf(out,"commands %llu  bytes sent %llu  send() %llu (%.2f/command, %llu waits)  recv() %llu  bytes received %llu\n",
+           (unsigned long long)nCommands,(unsigned long long)bytesSent.load(RELAXED),
+           (unsigned long long)sendCalls.load(RELAXED),nCommands ? (double)sendCalls.load(RELAXED) / nCommands : 0.0,
+           (unsigned long long)sendWaits.load(RELAXED),(unsigned long long)recvCalls.load(RELAXED),
+           (unsigned long long)bytesReceived.load(RELAXED));
+   if(seconds > 0)
+      fprintf(out,"%.0f commands/s  %.0f bytes/s over %.3f s\n",nCommands / seconds,bytesSent.load(RELAXED) / seconds,seconds);
+
+   const char* names[] = { "command","send","pace","ack wait","read" };
+   const CLatencyHistogram* histograms[] = { &command,&send,&pace,&ack,&read };
+   fprintf(out,"%-9s %10s %10s %10s %10s %10s %10s %10s %12s\n","(us)","count","mean","p50","p90","p99","p99.9","max","total ms");
+   for(int i = 0; i < 5; i++)
+   {
+      const CLatencyHistogram& h = *histograms[i];
+      fprintf(out,"%-9s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %12.1f\n",names[i],(unsigned long long)h.GetCount(),
+              h.GetMean() / 1e3,h.GetPercentile(50) / 1e3,h.GetPercentile(90) / 1e3,h.GetPercentile(99) / 1e3,
+              h.GetPercentile(99.9) / 1e3,h.GetMax() / 1e3,h.GetSum() / 1e6);
+   }
+}
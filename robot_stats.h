@@ -0,0 +1,82 @@
+#ifndef _ROBOT_STATS_H_
+#define _ROBOT_STATS_H_
+
+#include <cstdio>
+#include <cstdint>
+#include <atomic>
+
+#define HISTOGRAM_SUB_BITS  5  /// 32 linear sub-buckets per power of two, about 3% precision
+#define HISTOGRAM_MAX_BITS  40 /// values up to 2^40 ns (18 minutes) are told apart
+#define HISTOGRAM_BUCKETS   ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) /// 1152
+
+namespace openutils
+{
+   /**
+   * HDR-style latency histogram in nanoseconds: buckets are linear inside
+   * each power of two and logarithmic across them, so p50 and p99.9 are
+   * both reported to within about 3% from a fixed 9 KB table, whatever the
+   * range. Record() is meant for a single writing thread and costs a few
+   * adds; Snapshot() may be taken from any thread and sees every bucket
+   * as it was at some recent moment.
+   */
+   class CLatencyHistogram
+   {
+   private:
+      std::atomic<uint64_t> m_counts[HISTOGRAM_BUCKETS]; /// values per bucket
+      std::atomic<uint64_t> m_nCount; /// values recorded
+      std::atomic<uint64_t> m_nSum; /// sum of the values
+      std::atomic<uint64_t> m_nMax; /// largest value
+   public:
+      CLatencyHistogram(); /// Empty histogram
+      void Record(uint64_t ns,uint64_t count = 1); /// Adds count values of ns (single writer)
+      void Reset(); /// Forgets every value
+      void Snapshot(CLatencyHistogram* out) const; /// Copies the current counts into out
+      uint64_t GetCount() const { return m_nCount.load(std::memory_order_relaxed); } /// Returns the values recorded
+      uint64_t GetSum() const { return m_nSum.load(std::memory_order_relaxed); } /// Returns the sum of the values
+      uint64_t GetMax() const { return m_nMax.load(std::memory_order_relaxed); } /// Returns the largest value
+      double GetMean() const; /// Returns the mean, 0 if empty
+      uint64_t GetPercentile(double percent) const; /// Returns the value below which percent of values fall
+
+      static int GetBucket(uint64_t ns); /// Bucket index of a value
+      static uint64_t GetBucketTop(int bucket); /// Largest value of a bucket
+   private:
+      CLatencyHistogram(const CLatencyHistogram&); /// not copyable, use Snapshot()
+      void operator = (const CLatencyHistogram&);
+   };
+
+   /**
+   * Where a CRobot's time goes. Counters and histograms are written by the
+   * sending thread (send side) and the reading thread (receive side);
+   * CRobot::GetStats() returns a snapshot. Histograms are in nanoseconds.
+   */
+   struct CRobotStats
+   {
+      std::atomic<uint64_t> commands; /// commands written
+      std::atomic<uint64_t> bytesSent; /// bytes written
+      std::atomic<uint64_t> sendCalls; /// send() system calls
+      std::atomic<uint64_t> sendWaits; /// times send() found the socket full and waited
+      std::atomic<uint64_t> bytesReceived; /// bytes received
+      std::atomic<uint64_t> recvCalls; /// recv() system calls
+      CLatencyHistogram command; /// Send()/SendBatch() per command, writing and pacing
+      CLatencyHistogram send; /// time in the send loop per write, blocking included
+      CLatencyHistogram pace; /// time pacing per write: legacy sleep or window backpressure
+      CLatencyHistogram ack; /// time waiting for each acknowledgement
+      CLatencyHistogram read; /// time Read()/Poll() blocked waiting for data
+
+      CRobotStats(); /// Everything zero
+      void Reset(); /// Sets everything back to zero
+      void Snapshot(CRobotStats* out) const; /// Copies the current values into out
+      void Print(FILE* out,double seconds) const; /// Writes a table; seconds > 0 adds rates
+
+      static uint64_t Now(); /// Monotonic clock in ns
+      static void Add(std::atomic<uint64_t>& counter,uint64_t n) /// Single-writer increment
+      {
+         counter.store(counter.load(std::memory_order_relaxed) + n,std::memory_order_relaxed);
+      }
+   private:
+      CRobotStats(const CRobotStats&); /// not copyable, use Snapshot()
+      void operator = (const CRobotStats&);
+   };
+}
+
+#endif
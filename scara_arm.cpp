@@ -0,0 +1,86 @@
+/*|Includes|-------------------------------------------------------------------*/
+#include <stdio.h>  // fopen, fgets, sscanf
+#include <string.h> // strchr, strcmp
+#include "scara_arm.h"
+
+using namespace scara_solver;
+
+/**
+ * @brief Defaults to the Lab07 simulator arm.
+ */
+ScaraArmConfig::ScaraArmConfig() {
+   *this = ScaraArmConfig(Lab07Arm::LINK1, Lab07Arm::LINK2, Lab07Arm::MAX_THETA1_DEG, Lab07Arm::MAX_THETA2_DEG);
+}
+
+/**
+ * @brief Describes an arm and derives every constant the solvers need.
+ *
+ * @param link1 Length of the first link in mm.
+ * @param link2 Length of the second link in mm.
+ * @param maxTheta1Deg Limit of |J1| in degrees.
+ * @param maxTheta2Deg Limit of |J2| in degrees.
+ */
+ScaraArmConfig::ScaraArmConfig(double link1, double link2, double maxTheta1Deg, double maxTheta2Deg) {
+   LINK1 = link1;
+   LINK2 = link2;
+   MAX_THETA1_DEG = maxTheta1Deg;
+   MAX_THETA2_DEG = maxTheta2Deg;
+   MAX_THETA1_RAD = MAX_THETA1_DEG * SCARA_PI / 180.0;
+   MAX_THETA2_RAD = MAX_THETA2_DEG * SCARA_PI / 180.0;
+   LINK1_SQ = LINK1 * LINK1;
+   LINK2_SQ = LINK2 * LINK2;
+   TWO_LINK1_LINK2 = 2.0 * LINK1 * LINK2;
+   MAX_REACH = LINK1 + LINK2;
+   MIN_REACH = sqrt(LINK1_SQ + LINK2_SQ - TWO_LINK1_LINK2 * cos(SCARA_PI - MAX_THETA2_RAD));
+}
+
+/**
+ * @brief Reads the arm from a text file of "key = value" lines. Recognised
+ * keys are link1, link2, max_theta1 and max_theta2; blank lines and lines
+ * starting with '#' are ignored, and missing keys keep their current value.
+ *
+ * @param path Config file to read.
+ *
+ * @return true if the file was read and describes a usable arm
+ */
+bool ScaraArmConfig::Load(const char* path) {
+   FILE* file = fopen(path, "r");
+   if (file == NULL) return false;
+
+   double link1 = LINK1, link2 = LINK2, max1 = MAX_THETA1_DEG, max2 = MAX_THETA2_DEG;
+   char line[256], key[64];
+   double value;
+   while (fgets(line, sizeof(line), file) != NULL) {
+      char* equals = strchr(line, '=');
+      if (line[0] == '#' || equals == NULL) continue;
+      *equals = ' ';
+      if (sscanf(line, "%63s %lf", key, &value) != 2) continue;
+      if (strcmp(key, "link1") == 0) link1 = value;
+      else if (strcmp(key, "link2") == 0) link2 = value;
+      else if (strcmp(key, "max_theta1") == 0) max1 = value;
+      else if (strcmp(key, "max_theta2") == 0) max2 = value;
+   }
+   fclose(file);
+
+   if (link1 <= 0 || link2 <= 0 || max1 <= 0 || max1 > 180 || max2 <= 0 || max2 > 180) return false;
+   *this = ScaraArmConfig(link1, link2, max1, max2);
+   return true;
+}
+
+int ScaraArmConfig::FK(double j1, double j2, double* x, double* y) const {
+   return fk(*this, j1, j2, x, y);
+}
+
+int ScaraArmConfig::IK(double x, double y, double* j1, double* j2, bool right) const {
+   return ik(*this, x, y, j1, j2, right ? 1.0 : -1.0);
+}
+
+size_t ScaraArmConfig::IKBatch(const double* x, const double* y, double* j1, double* j2,
+                               signed char* error, size_t n, bool right) const {
+   return ikRun<ScaraArmConfig, NativeLanes>(*this, x, y, j1, j2, error, n, right ? 1.0 : -1.0);
+}
+
+size_t ScaraArmConfig::FKBatch(const double* j1, const double* j2, double* x, double* y,
+                               unsigned char* status, size_t n) const {
+   return fkRun<ScaraArmConfig, NativeLanes>(*this, j1, j2, x, y, status, n);
+}
@@ -0,0 +1,314 @@
+/*|SCARA Arm|------------------------------------------------------------------
+#
+# Two-link SCARA kinematics parameterised by arm geometry.
+#
+#   ScaraArm<Geometry>  Geometry supplies LINK1, LINK2, MAX_THETA1_DEG and
+#                       MAX_THETA2_DEG as static constexpr members; every
+#                       derived constant (squares, reach limits, limit
+#                       radians) is evaluated at compile time.
+#   ScaraArmConfig      The same kinematics for an arm whose dimensions are
+#                       only known at run time, e.g. read from a config file.
+#
+# Both share the solver templates below, so a configured arm and a compiled
+# one with equal dimensions give identical results.
+# -----------------------------------------------------------------------------*/
+#ifndef _SCARA_ARM_H_
+#define _SCARA_ARM_H_
+
+#include <math.h>
+#include <stddef.h>
+#include "scara_simd.h"
+
+#define SCARA_PI              3.14159265358979323846
+
+/*|Compile-time math|----------------------------------------------------------*/
+namespace scara_constexpr {
+
+constexpr double sqrtIter(double x, double guess, int steps) {
+   return steps == 0 ? guess : sqrtIter(x, 0.5 * (guess + x / guess), steps - 1);
+}
+
+/**
+ * @brief sqrt(x) by Newton iteration; exact to the last bit for arm-sized values.
+ */
+constexpr double sqrt(double x) {
+   return x <= 0.0 ? 0.0 : sqrtIter(x, x > 1.0 ? x : 1.0, 64);
+}
+
+constexpr double cosSeries(double x2, double term, int n, double sum) {
+   return n > 40 ? sum : cosSeries(x2, -term * x2 / ((2*n - 1) * (2*n)), n + 1, sum + term);
+}
+
+/**
+ * @brief cos(x) for |x| <= pi from its Taylor series.
+ */
+constexpr double cos(double x) {
+   return cosSeries(x * x, 1.0, 1, 0.0);
+}
+
+} // namespace scara_constexpr
+
+/*|Geometry|-------------------------------------------------------------------*/
+
+/**
+ * @brief The ROBT 1270 simulator arm.
+ */
+struct Lab07Geometry {
+   static constexpr double LINK1 = 350.0;          // mm
+   static constexpr double LINK2 = 250.0;          // mm
+   static constexpr double MAX_THETA1_DEG = 150.0; // |J1| limit
+   static constexpr double MAX_THETA2_DEG = 170.0; // |J2| limit
+};
+
+/*|Solvers|--------------------------------------------------------------------*/
+// Each takes an Arm exposing the ScaraArm constants below, either as static
+// constexpr members or as plain runtime members.
+namespace scara_solver {
+
+using namespace scara_simd;
+
+/**
+ * @brief Forward kinematics. Returns 0, or -1/-2 if J1/J2 is out of range.
+ */
+template <class Arm>
+inline int fk(const Arm& arm, double j1, double j2, double* x, double* y) {
+   if (fabs(j1) > arm.MAX_THETA1_DEG) return -1;
+   if (fabs(j2) > arm.MAX_THETA2_DEG) return -2;
+
+   j1 *= SCARA_PI/180.0;
+   j2 *= SCARA_PI/180.0;
+   *x = arm.LINK1*cos(j1) + arm.LINK2*cos(j1+j2);
+   *y = arm.LINK1*sin(j1) + arm.LINK2*sin(j1+j2);
+   return 0;
+}
+
+/**
+ * @brief Inverse kinematics. Returns 0, -1 beyond max reach or joint limits,
+ * -2 inside min reach. side is +1 for the right arm, -1 for the left.
+ */
+template <class Arm>
+inline int ik(const Arm& arm, double x, double y, double* j1, double* j2, double side) {
+   const double LL = x*x + y*y;
+   const double L = sqrt(LL);
+
+   if (L > arm.MAX_REACH) return -1;
+   if (L < arm.MIN_REACH) return -2;
+
+   const double beta = atan2(y, x);
+   const double alpha = acos((LL + arm.LINK1_SQ - arm.LINK2_SQ) / (2*L*arm.LINK1));
+
+   *j1 = beta + side*alpha;
+   *j2 = atan2(y - (arm.LINK1 * sin(*j1)), x - (arm.LINK1 * cos(*j1))) - *j1;
+
+   // Convert to degrees
+   *j1 *= 180/SCARA_PI;
+   *j2 *= 180/SCARA_PI;
+
+   if (*j2 < -arm.MAX_THETA2_DEG) *j2 += 360;
+   if (*j2 > arm.MAX_THETA2_DEG) *j2 -= 360;
+   if (*j1 < -arm.MAX_THETA1_DEG) *j1 += 360;
+   if (*j1 > arm.MAX_THETA1_DEG) *j1 -= 360;
+
+   if (fabs(*j1) > arm.MAX_THETA1_DEG) return -1;
+   if (fabs(*j2) > arm.MAX_THETA2_DEG) return -1;
+   return 0;
+}
+
+/**
+ * @brief IK for one vector of points. Instead of acos/sin/cos it rotates
+ * (x, y) by the shoulder offset alpha using cos(alpha) from the law of
+ * cosines and sin(alpha) = sqrt(1 - cos^2), and takes the elbow angle from
+ * its own cosine, leaving two atan2 calls per point. Angles come out in
+ * (-180, 180] rather than the scalar's unwrapped range, which the
+ * +/-360 wraparound below maps to the same final values.
+ */
+template <class Arm, class V>
+inline void ikKernel(const Arm& arm, V x, V y, V* j1, V* j2, V* error, double side) {
+   const V zero(0.0), one(1.0);
+
+   V LL = x*x + y*y;
+   V L = vsqrt(LL);
+
+   V cosAlpha = (LL + V(arm.LINK1_SQ - arm.LINK2_SQ)) / (V(2*arm.LINK1) * L);
+   V sinAlpha = V(side) * vsqrt(vmax(zero, one - cosAlpha*cosAlpha));
+   V shoulder = vatan2(y*cosAlpha + x*sinAlpha, x*cosAlpha - y*sinAlpha);
+
+   V cosElbow = (LL - V(arm.LINK1_SQ + arm.LINK2_SQ)) / V(arm.TWO_LINK1_LINK2);
+   V sinElbow = V(-side) * vsqrt(vmax(zero, one - cosElbow*cosElbow));
+   V elbow = vatan2(sinElbow, cosElbow);
+
+   // Convert to degrees
+   V a1 = shoulder * V(180/SCARA_PI);
+   V a2 = elbow * V(180/SCARA_PI);
+
+   a2 = vselect(a2 < V(-arm.MAX_THETA2_DEG), a2 + V(360.0), a2);
+   a2 = vselect(a2 > V(arm.MAX_THETA2_DEG), a2 - V(360.0), a2);
+   a1 = vselect(a1 < V(-arm.MAX_THETA1_DEG), a1 + V(360.0), a1);
+   a1 = vselect(a1 > V(arm.MAX_THETA1_DEG), a1 - V(360.0), a1);
+
+   V limit = vselect(vabs(a1) > V(arm.MAX_THETA1_DEG) || vabs(a2) > V(arm.MAX_THETA2_DEG), V(-1.0), zero);
+   *error = vselect(L > V(arm.MAX_REACH), V(-1.0), vselect(L < V(arm.MIN_REACH), V(-2.0), limit));
+   *j1 = a1;
+   *j2 = a2;
+}
+
+template <class Arm, class V>
+inline size_t ikRun(const Arm& arm, const double* x, const double* y, double* j1, double* j2,
+                    signed char* error, size_t n, double side) {
+   const size_t W = Lanes<V>::WIDTH;
+   size_t valid = 0, i = 0;
+   double codes[W];
+   V a1, a2, err;
+
+   for (; i + W <= n; i += W) {
+      ikKernel(arm, vload(x + i, V()), vload(y + i, V()), &a1, &a2, &err, side);
+      vstore(j1 + i, a1);
+      vstore(j2 + i, a2);
+      vstore(codes, err);
+      for (size_t k = 0; k < W; k++) {
+         error[i + k] = (signed char)codes[k];
+         valid += codes[k] == 0.0;
+      }
+   }
+   for (; i < n; i++) {
+      double s1, s2, code;
+      ikKernel(arm, x[i], y[i], &s1, &s2, &code, side);
+      j1[i] = s1;
+      j2[i] = s2;
+      error[i] = (signed char)code;
+      valid += code == 0.0;
+   }
+   return valid;
+}
+
+/**
+ * @brief FK for one vector of joint angles in degrees. Lanes outside the
+ * joint limits are flagged in *status (bit 0: J1, bit 1: J2) but still computed.
+ */
+template <class Arm, class V>
+inline void fkKernel(const Arm& arm, V j1, V j2, V* x, V* y, V* status) {
+   V s1, c1, s12, c12;
+   vsincos(j1 * V(SCARA_PI/180.0), &s1, &c1);
+   vsincos((j1 + j2) * V(SCARA_PI/180.0), &s12, &c12);
+   *x = V(arm.LINK1) * c1 + V(arm.LINK2) * c12;
+   *y = V(arm.LINK1) * s1 + V(arm.LINK2) * s12;
+   *status = vselect(vabs(j1) > V(arm.MAX_THETA1_DEG), V(1.0), V(0.0))
+           + vselect(vabs(j2) > V(arm.MAX_THETA2_DEG), V(2.0), V(0.0));
+}
+
+template <class Arm, class V>
+inline size_t fkRun(const Arm& arm, const double* j1, const double* j2, double* x, double* y,
+                    unsigned char* status, size_t n) {
+   const size_t W = Lanes<V>::WIDTH;
+   size_t valid = 0, i = 0;
+   double codes[W];
+   V px, py, st;
+
+   for (; i + W <= n; i += W) {
+      fkKernel(arm, vload(j1 + i, V()), vload(j2 + i, V()), &px, &py, &st);
+      vstore(x + i, px);
+      vstore(y + i, py);
+      vstore(codes, st);
+      for (size_t k = 0; k < W; k++) {
+         status[i + k] = (unsigned char)codes[k];
+         valid += codes[k] == 0.0;
+      }
+   }
+   for (; i < n; i++) {
+      double sx, sy, code;
+      fkKernel(arm, j1[i], j2[i], &sx, &sy, &code);
+      x[i] = sx;
+      y[i] = sy;
+      status[i] = (unsigned char)code;
+      valid += code == 0.0;
+   }
+   return valid;
+}
+
+#if defined(SCARA_SIMD_AVX2)
+typedef F64x4 NativeLanes;
+#elif defined(SCARA_SIMD_SSE2)
+typedef F64x2 NativeLanes;
+#else
+typedef double NativeLanes;
+#endif
+
+} // namespace scara_solver
+
+/*|ScaraArm|-------------------------------------------------------------------*/
+
+/**
+ * @brief Kinematics for an arm whose geometry is fixed at compile time.
+ */
+template <class Geometry>
+struct ScaraArm {
+   static constexpr double LINK1 = Geometry::LINK1;
+   static constexpr double LINK2 = Geometry::LINK2;
+   static constexpr double MAX_THETA1_DEG = Geometry::MAX_THETA1_DEG;
+   static constexpr double MAX_THETA2_DEG = Geometry::MAX_THETA2_DEG;
+   static constexpr double MAX_THETA1_RAD = MAX_THETA1_DEG * SCARA_PI / 180.0;
+   static constexpr double MAX_THETA2_RAD = MAX_THETA2_DEG * SCARA_PI / 180.0;
+   static constexpr double LINK1_SQ = LINK1 * LINK1;
+   static constexpr double LINK2_SQ = LINK2 * LINK2;
+   static constexpr double TWO_LINK1_LINK2 = 2.0 * LINK1 * LINK2;
+   static constexpr double MAX_REACH = LINK1 + LINK2;
+   // Reach with the elbow folded to its limit: law of cosines on (180 - MAX_THETA2)
+   static constexpr double MIN_REACH =
+      scara_constexpr::sqrt(LINK1_SQ + LINK2_SQ - TWO_LINK1_LINK2 * scara_constexpr::cos(SCARA_PI - MAX_THETA2_RAD));
+
+   static int FK(double j1, double j2, double* x, double* y) {
+      return scara_solver::fk(ScaraArm(), j1, j2, x, y);
+   }
+   static int IK(double x, double y, double* j1, double* j2, bool right) {
+      return scara_solver::ik(ScaraArm(), x, y, j1, j2, right ? 1.0 : -1.0);
+   }
+   static size_t IKBatch(const double* x, const double* y, double* j1, double* j2,
+                         signed char* error, size_t n, bool right) {
+      return scara_solver::ikRun<ScaraArm, scara_solver::NativeLanes>(ScaraArm(), x, y, j1, j2, error, n, right ? 1.0 : -1.0);
+   }
+   static size_t FKBatch(const double* j1, const double* j2, double* x, double* y,
+                         unsigned char* status, size_t n) {
+      return scara_solver::fkRun<ScaraArm, scara_solver::NativeLanes>(ScaraArm(), j1, j2, x, y, status, n);
+   }
+};
+
+template <class G> constexpr double ScaraArm<G>::LINK1;
+template <class G> constexpr double ScaraArm<G>::LINK2;
+template <class G> constexpr double ScaraArm<G>::MAX_THETA1_DEG;
+template <class G> constexpr double ScaraArm<G>::MAX_THETA2_DEG;
+template <class G> constexpr double ScaraArm<G>::MAX_THETA1_RAD;
+template <class G> constexpr double ScaraArm<G>::MAX_THETA2_RAD;
+template <class G> constexpr double ScaraArm<G>::LINK1_SQ;
+template <class G> constexpr double ScaraArm<G>::LINK2_SQ;
+template <class G> constexpr double ScaraArm<G>::TWO_LINK1_LINK2;
+template <class G> constexpr double ScaraArm<G>::MAX_REACH;
+template <class G> constexpr double ScaraArm<G>::MIN_REACH;
+
+typedef ScaraArm<Lab07Geometry> Lab07Arm;
+
+/*|ScaraArmConfig|-------------------------------------------------------------*/
+
+/**
+ * @brief Kinematics for an arm whose geometry is read at run time. Derived
+ * constants are computed once, in the constructor.
+ */
+class ScaraArmConfig {
+public:
+   double LINK1, LINK2, MAX_THETA1_DEG, MAX_THETA2_DEG;
+   double MAX_THETA1_RAD, MAX_THETA2_RAD;
+   double LINK1_SQ, LINK2_SQ, TWO_LINK1_LINK2;
+   double MAX_REACH, MIN_REACH;
+
+   ScaraArmConfig();
+   ScaraArmConfig(double link1, double link2, double maxTheta1Deg, double maxTheta2Deg);
+   bool Load(const char* path);
+
+   int FK(double j1, double j2, double* x, double* y) const;
+   int IK(double x, double y, double* j1, double* j2, bool right) const;
+   size_t IKBatch(const double* x, const double* y, double* j1, double* j2,
+                  signed char* error, size_t n, bool right) const;
+   size_t FKBatch(const double* j1, const double* j2, double* x, double* y,
+                  unsigned char* status, size_t n) const;
+};
+
+#endif
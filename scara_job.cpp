@@ -0,0 +1,168 @@
+/*|SCARA Job Compiler and Player|----------------------------------------------
+#
+# Compiles a drawing once - stroke order, arm choice, line planning and
+# command encoding - into a binary job file, and plays job files to the
+# simulator straight from a memory mapping.
+#
+# Usage: scara_job compile <drawing> <job> [-a left|right] [-t mm] [-s speed] [-c r,g,b]
+#        scara_job play <job> [-h host] [-p port] [-f stroke] [-m pacing]
+#        scara_job info <job>
+#   -a left|right  preferred arm solution (default left)
+#   -t mm          how far the traced path may stray from the drawing (default 0.5)
+#   -s speed       MOTOR_SPEED for the job: high, medium or low
+#   -c r,g,b       PEN_COLOR for the job
+#   -h host        simulator host (default 127.0.0.1)
+#   -p port        simulator port (default 1270)
+#   -f stroke      resume at this stroke
+#   -m pacing      legacy, window, predictive or none (default legacy)
+#
+# A drawing is a text file of points in mm, "x y" or "x, y" per line; a
+# blank line ends a stroke and '#' starts a comment. If playback stops,
+# the stroke to resume at is printed.
+# -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "robot.h"
+#include "job_file.h"
+#include "job_player.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds(Clock::time_point start) {
+   return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static bool readDrawing(const char* path, std::vector<Stroke>* strokes) {
+   FILE* file = fopen(path, "r");
+   if (file == NULL) return false;
+   char line[256];
+   Stroke stroke;
+   while (fgets(line, sizeof(line), file) != NULL) {
+      char* comment = strchr(line, '#');
+      if (comment != NULL) *comment = '\0';
+      PathPoint p;
+      if (sscanf(line, "%lf%*[ ,\t]%lf", &p.x, &p.y) == 2) {
+         stroke.push_back(p);
+      } else if (strspn(line, " \t\r\n") == strlen(line) && comment == NULL && !stroke.empty()) {
+         strokes->push_back(stroke);
+         stroke.clear();
+      }
+   }
+   if (!stroke.empty()) strokes->push_back(stroke);
+   fclose(file);
+   return true;
+}
+
+static int compile(int argc, char** argv) {
+   if (argc < 4) return -1;
+   CJobCompiler compiler;
+   for (int i = 4; i < argc; i++) {
+      int r, g, b;
+      if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+         compiler.SetArm(strcmp(argv[++i], "right") == 0 ? RIGHT_ARM_SOLUTION : LEFT_ARM_SOLUTION);
+      else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+         if (!compiler.SetTolerance(atof(argv[++i]))) {
+            fprintf(stderr, "tolerance must be a positive number of mm: %s\n", argv[i]);
+            return 1;
+         }
+      } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+         const char* speed = argv[++i];
+         compiler.SetMotorSpeed(strcmp(speed, "low") == 0 ? MOTOR_SPEED_LOW
+                                : strcmp(speed, "medium") == 0 ? MOTOR_SPEED_MEDIUM : MOTOR_SPEED_HIGH);
+      } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc && sscanf(argv[++i], "%d,%d,%d", &r, &g, &b) == 3)
+         compiler.SetPenColor(r, g, b);
+      else return -1;
+   }
+
+   std::vector<Stroke> strokes;
+   if (!readDrawing(argv[2], &strokes)) {
+      fprintf(stderr, "cannot read %s\n", argv[2]);
+      return 1;
+   }
+   Clock::time_point start = Clock::now();
+   compiler.Compile(strokes);
+   double elapsed = seconds(start);
+   if (!compiler.Write(argv[3])) {
+      fprintf(stderr, "cannot write %s\n", argv[3]);
+      return 1;
+   }
+   printf("%zu strokes -> %d strokes (%d unreachable), %d commands, %d bytes, %.1f deg pen-up travel, compiled in %.3f s\n",
+          strokes.size(), compiler.GetStrokeCount(), compiler.GetSkippedCount(), compiler.GetCommandCount(),
+          compiler.GetLength(), compiler.GetTravel(), elapsed);
+   return 0;
+}
+
+static int info(const CJobFile& job) {
+   const CJobHeader& header = job.GetHeader();
+   int gaps = 0;
+   for (int k = 0; k < job.GetStrokeCount(); k++) gaps += (job.GetStroke(k).flags & JOB_STROKE_GAPS) != 0;
+   printf("version %u: %d strokes (%u unreachable, %d with pen lifts), %d commands (%d prologue), %llu bytes, %.1f deg pen-up travel\n",
+          header.version, job.GetStrokeCount(), header.skipped, gaps, job.GetCommandCount(), job.GetPrologueCount(),
+          (unsigned long long)header.dataSize, header.travel);
+   return 0;
+}
+
+static int play(int argc, char** argv, const CJobFile& job) {
+   const char* host = IPV4_STRING;
+   int port = PORT, from = 0;
+   PacingMode pacing = PACING_LEGACY;
+   for (int i = 3; i < argc; i++) {
+      if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) host = argv[++i];
+      else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) port = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) from = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+         const char* mode = argv[++i];
+         pacing = strcmp(mode, "window") == 0 ? PACING_WINDOW : strcmp(mode, "predictive") == 0 ? PACING_PREDICTIVE
+                  : strcmp(mode, "none") == 0 ? PACING_NONE : PACING_LEGACY;
+      } else return -1;
+   }
+
+   CWinSock::Initialize();
+   CRobot robot;
+   if (!robot.Connect(host, port)) {
+      fprintf(stderr, "cannot connect to %s:%d\n", host, port);
+      CWinSock::Finalize();
+      return 1;
+   }
+   robot.SetPacing(pacing);
+   CJobPlayer player(&robot, &job);
+   player.Seek(from);
+   Clock::time_point start = Clock::now();
+   int status = 0;
+   try {
+      // A stroke at a time, so the resume point is exact
+      while (!player.IsDone()) player.Play(1);
+      robot.Drain();
+      printf("played strokes %d..%d in %.3f s\n", from, job.GetStrokeCount() - 1, seconds(start));
+   } catch (CSocketException& e) {
+      fprintf(stderr, "error %d: %s\nresume with -f %d\n", e.GetCode(), e.GetMessage(), player.GetNext());
+      status = 1;
+   }
+   robot.Close();
+   return status;
+}
+
+int main(int argc, char** argv) {
+   int status = -1;
+   if (argc >= 4 && strcmp(argv[1], "compile") == 0) {
+      status = compile(argc, argv);
+   } else if (argc >= 3 && (strcmp(argv[1], "play") == 0 || strcmp(argv[1], "info") == 0)) {
+      CJobFile job;
+      if (!job.Open(argv[2])) {
+         fprintf(stderr, "%s is not a valid job file\n", argv[2]);
+         return 1;
+      }
+      status = strcmp(argv[1], "info") == 0 ? info(job) : play(argc, argv, job);
+   }
+   if (status < 0) {
+      fprintf(stderr, "usage: %s compile <drawing> <job> [-a left|right] [-t mm] [-s speed] [-c r,g,b]\n"
+                      "       %s play <job> [-h host] [-p port] [-f stroke] [-m pacing]\n"
+                      "       %s info <job>\n", argv[0], argv[0], argv[0]);
+      return 1;
+   }
+   return status;
+}
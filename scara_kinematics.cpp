@@ -0,0 +1,85 @@
+/*|Includes|-------------------------------------------------------------------*/
+#include "scara_kinematics.h"
+
+/**
+ * @brief This function will calculate the x,y coordinates given two joint angles.
+ *
+ * @param _j1 Angle of joint 1 in degrees.
+ * @param _j2 Angle of joint 2 in degrees.
+ * @param _x The tool position along the x-axis. Pointer
+ * @param _y The tool position along the y-axis. Pointer
+ *
+ * @return inRange (0) in range, (-1) out of range
+ */
+int scaraFK (double _j1, double _j2, double* _x, double* _y) {
+   return Lab07Arm::FK(_j1, _j2, _x, _y);
+}
+
+/**
+* @brief Calculate two joint angles given the x,y coordinates.
+*
+* @param _x - The tool position along the x-axis.
+* @param _y - The tool position along the y-axis.
+* @param _j1 - Angle of joint 1 in degrees. Pointer
+* @param _j2 - Angle of joint 2 in degrees. Pointer
+* @param arm - Selects which solution to try.
+*
+* @return - (0) in range, (-1) out of range
+*/
+int scaraIK (double _x, double _y, double* _j1, double* _j2, int arm) {
+   return Lab07Arm::IK(_x, _y, _j1, _j2, arm == RIGHT_ARM_SOLUTION);
+}
+
+/**
+* @brief Batch inverse kinematics over structure-of-arrays buffers.
+*
+* Same limits, wraparound and arm selection as scaraIK(); joint angles agree
+* with it to better than 1e-9 degrees. Outputs for points whose error code is
+* not 0 are unspecified.
+*
+* @param _x - n tool positions along the x-axis.
+* @param _y - n tool positions along the y-axis.
+* @param _j1 - n angles of joint 1 in degrees. Output
+* @param _j2 - n angles of joint 2 in degrees. Output
+* @param _error - n error codes as returned by scaraIK(). Output
+* @param n - Number of points.
+* @param arm - Selects which solution to compute.
+*
+* @return - number of points in range
+*/
+size_t scaraIKBatch (const double* _x, const double* _y, double* _j1, double* _j2, signed char* _error, size_t n, int arm) {
+   return Lab07Arm::IKBatch(_x, _y, _j1, _j2, _error, n, arm == RIGHT_ARM_SOLUTION);
+}
+
+/**
+* @brief Batch forward kinematics over joint trajectories.
+*
+* Applies the same joint limit checks as scaraFK(), but reports every
+* violated limit as a bit mask instead of the first one. Positions agree
+* with scaraFK() to better than 1e-9 mm.
+*
+* @param _j1 - n angles of joint 1 in degrees.
+* @param _j2 - n angles of joint 2 in degrees.
+* @param _x - n tool positions along the x-axis. Output
+* @param _y - n tool positions along the y-axis. Output
+* @param _status - n masks of FK_J1_OUT_OF_RANGE/FK_J2_OUT_OF_RANGE, 0 in range. Output
+* @param n - Number of samples.
+*
+* @return - number of samples in range
+*/
+size_t scaraFKBatch (const double* _j1, const double* _j2, double* _x, double* _y, unsigned char* _status, size_t n) {
+   return Lab07Arm::FKBatch(_j1, _j2, _x, _y, _status, n);
+}
+
+/**
+ * @brief Name of the instruction set the batch functions were compiled for.
+ */
+const char* scaraSimdBackend (void) {
+#if defined(SCARA_SIMD_AVX2)
+   return "AVX2";
+#elif defined(SCARA_SIMD_SSE2)
+   return "SSE2";
+#else
+   return "scalar";
+#endif
+}
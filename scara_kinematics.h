@@ -0,0 +1,31 @@
+/*|SCARA Kinematics|-----------------------------------------------------------
+#
+# Forward and inverse kinematics for the simulator arm (Lab07Arm). The scalar
+# functions are the ones the console client uses; the batch variants solve
+# whole point buffers with SIMD and give the same results to well within the
+# 0.01 degree resolution of the wire format. Other arms use ScaraArm<> or
+# ScaraArmConfig from scara_arm.h directly.
+# -----------------------------------------------------------------------------*/
+#ifndef _SCARA_KINEMATICS_H_
+#define _SCARA_KINEMATICS_H_
+
+#include <stddef.h>
+#include "scara_arm.h"
+
+/*|CONSTANTS|------------------------------------------------------------------*/
+#define PI                    SCARA_PI
+#define LEFT_ARM_SOLUTION     0
+#define RIGHT_ARM_SOLUTION    1
+
+// scaraFKBatch status bits
+#define FK_J1_OUT_OF_RANGE    0x01
+#define FK_J2_OUT_OF_RANGE    0x02
+
+/*|Function Prototypes|--------------------------------------------------------*/
+int scaraFK (double, double, double*, double*);
+int scaraIK (double, double, double*, double*, int);
+size_t scaraIKBatch (const double*, const double*, double*, double*, signed char*, size_t, int);
+size_t scaraFKBatch (const double*, const double*, double*, double*, unsigned char*, size_t);
+const char* scaraSimdBackend (void);
+
+#endif
@@ -0,0 +1,463 @@
+/*|Includes|-------------------------------------------------------------------*/
+#include <math.h>   // sqrt, fabs, ceil
+#include <queue>    // priority_queue
+#include <algorithm> // reverse
+#include "scara_motion.h"
+
+/*|Local Helpers|--------------------------------------------------------------*/
+
+/**
+ * @brief Distance from (px, py) to the segment (ax, ay)-(bx, by).
+ */
+static double distanceToSegment(double px, double py, double ax, double ay, double bx, double by) {
+   const double dx = bx - ax, dy = by - ay;
+   const double lengthSq = dx*dx + dy*dy;
+   double t = lengthSq > 0 ? ((px - ax)*dx + (py - ay)*dy) / lengthSq : 0;
+   if (t < 0) t = 0;
+   if (t > 1) t = 1;
+   const double ex = ax + t*dx - px, ey = ay + t*dy - py;
+   return sqrt(ex*ex + ey*ey);
+}
+
+/**
+ * @brief Upper bound on the distance between the line and the arc the
+ * simulator traces when joints move linearly from a to b.
+ *
+ * Over the move the tool travels at most (LINK1 + LINK2)|dJ1| + LINK2|dJ2|
+ * (in radians), so every point of the arc lies within half a sample
+ * spacing of travel from a sample. The arc is sampled finely enough that
+ * this gap is at most a quarter of the tolerance; sampling stops as soon
+ * as the bound passes the tolerance.
+ */
+static double jointPathDeviation(const JointWaypoint& a, const JointWaypoint& b,
+                                 double x0, double y0, double x1, double y1, double tolerance) {
+   const double travel = ((Lab07Arm::LINK1 + Lab07Arm::LINK2) * fabs(b.j1 - a.j1) +
+                          Lab07Arm::LINK2 * fabs(b.j2 - a.j2)) * SCARA_PI / 180.0;
+   const int samples = (int)ceil(2 * travel / tolerance) + 1;
+   const double gap = travel / (2 * samples);
+   double worst = 0;
+   for (int i = 1; i < samples && worst + gap <= tolerance; i++) {
+      double x, y;
+      const double s = (double)i / samples;
+      scaraFK(a.j1 + s*(b.j1 - a.j1), a.j2 + s*(b.j2 - a.j2), &x, &y);
+      const double d = distanceToSegment(x, y, x0, y0, x1, y1);
+      if (d > worst) worst = d;
+   }
+   return worst + gap;
+}
+
+/**
+ * @brief Plans a straight-line move as the fewest joint-space waypoints that
+ * keep the traced path within tolerance of the line.
+ *
+ * Starts with the single joint move from start to end and bisects, in
+ * Cartesian space, every span whose joint-interpolated path may stray more
+ * than tolerance from the line. Spans are refined depth first with an
+ * explicit stack, so waypoints come out in path order.
+ *
+ * @param x0, y0 - Start of the line (the current tool position).
+ * @param x1, y1 - End of the line.
+ * @param arm - LEFT_ARM_SOLUTION or RIGHT_ARM_SOLUTION, held for the whole line.
+ * @param tolerance - Allowed deviation in mm, raised to MIN_LINE_TOLERANCE if finer.
+ * @param waypoints - Receives the waypoints after the start, ending at (x1, y1);
+ *                    left untouched on failure. Output
+ *
+ * @return - (0) success, LINE_BAD_TOLERANCE (-3) if tolerance is not positive,
+ *           otherwise the scaraIK error (-1 or -2) of the first unreachable point
+ */
+int planLinearMove (double x0, double y0, double x1, double y1, int arm, double tolerance,
+                    std::vector<JointWaypoint>* waypoints) {
+   struct Span { double t0, t1; JointWaypoint q0, q1; int depth; };
+   JointWaypoint start, end;
+   int error;
+
+   if (!(tolerance > 0)) return LINE_BAD_TOLERANCE;
+   if (tolerance < MIN_LINE_TOLERANCE) tolerance = MIN_LINE_TOLERANCE;
+   if ((error = scaraIK(x0, y0, &start.j1, &start.j2, arm)) != 0) return error;
+   if ((error = scaraIK(x1, y1, &end.j1, &end.j2, arm)) != 0) return error;
+
+   // Spans are pushed right half first so the left half is emitted first
+   std::vector<JointWaypoint> planned;
+   std::vector<Span> stack;
+   Span whole = { 0.0, 1.0, start, end, 0 };
+   stack.push_back(whole);
+   while (!stack.empty()) {
+      Span span = stack.back();
+      stack.pop_back();
+
+      if (span.depth >= MAX_LINE_SUBDIVISION ||
+          jointPathDeviation(span.q0, span.q1, x0, y0, x1, y1, tolerance) <= tolerance) {
+         planned.push_back(span.q1);
+         continue;
+      }
+
+      const double tm = 0.5 * (span.t0 + span.t1);
+      JointWaypoint mid;
+      if ((error = scaraIK(x0 + tm*(x1 - x0), y0 + tm*(y1 - y0), &mid.j1, &mid.j2, arm)) != 0) return error;
+
+      Span right = { tm, span.t1, mid, span.q1, span.depth + 1 };
+      Span left = { span.t0, tm, span.q0, mid, span.depth + 1 };
+      stack.push_back(right);
+      stack.push_back(left);
+   }
+   waypoints->insert(waypoints->end(), planned.begin(), planned.end());
+   return 0;
+}
+
+/**
+ * @brief Removes vertices from a polyline while every original vertex stays
+ * within tolerance of the simplified one (Visvalingam-Whyatt order).
+ *
+ * Each surviving edge carries a bound on how far the vertices it replaced
+ * lie from it. Removing a vertex that lies d from the chord joining its
+ * neighbours moves both of its edges at most d, so the vertices under the
+ * new chord lie within d plus the larger bound of the two edges; that sum
+ * is the vertex's cost. The cheapest vertex is removed repeatedly and its
+ * neighbours re-scored, using a min-heap with lazy deletion over a linked
+ * list of survivors: O(n log n) time, no recursion. The bound is
+ * conservative, so a few removable vertices may be kept. The end points
+ * are always kept.
+ *
+ * @param path - Polyline to simplify in place.
+ * @param tolerance - Largest distance in mm from any original vertex to the result.
+ *
+ * @return - number of vertices removed
+ */
+size_t simplifyPath (std::vector<PathPoint>* path, double tolerance) {
+   struct Candidate {
+      double cost;
+      size_t index;
+      unsigned version;
+      bool operator<(const Candidate& other) const { return cost > other.cost; }
+   };
+   std::vector<PathPoint>& points = *path;
+   const size_t n = points.size();
+   if (n < 3) return 0;
+
+   std::vector<size_t> prev(n), next(n);
+   std::vector<unsigned> version(n, 0);
+   std::vector<bool> removed(n, false);
+   std::vector<double> edgeError(n, 0.0); // bound for the edge from a survivor to the next
+   std::priority_queue<Candidate> heap;
+
+   for (size_t i = 0; i < n; i++) {
+      prev[i] = i - 1;
+      next[i] = i + 1;
+   }
+   auto cost = [&](size_t i) {
+      const size_t p = prev[i], q = next[i];
+      const double d = distanceToSegment(points[i].x, points[i].y, points[p].x, points[p].y,
+                                         points[q].x, points[q].y);
+      return d + (edgeError[p] > edgeError[i] ? edgeError[p] : edgeError[i]);
+   };
+   for (size_t i = 1; i + 1 < n; i++) {
+      Candidate c = { cost(i), i, 0 };
+      heap.push(c);
+   }
+
+   size_t removedCount = 0;
+   while (!heap.empty()) {
+      Candidate c = heap.top();
+      heap.pop();
+      if (removed[c.index] || c.version != version[c.index]) continue;
+      if (c.cost > tolerance) break;
+
+      // Unlink the vertex, carry its bound to the new edge and re-score its interior neighbours
+      const size_t p = prev[c.index], q = next[c.index];
+      removed[c.index] = true;
+      removedCount++;
+      next[p] = q;
+      prev[q] = p;
+      edgeError[p] = c.cost;
+      const size_t neighbours[2] = { p, q };
+      for (int k = 0; k < 2; k++) {
+         const size_t i = neighbours[k];
+         if (i == 0 || i == n - 1) continue;
+         Candidate updated = { cost(i), i, ++version[i] };
+         heap.push(updated);
+      }
+   }
+
+   size_t kept = 0;
+   for (size_t i = 0; i < n; i++)
+      if (!removed[i]) points[kept++] = points[i];
+   points.resize(kept);
+   return removedCount;
+}
+
+/*|Stroke Ordering|------------------------------------------------------------*/
+
+/**
+ * @brief Pen-up travel cost between two joint positions. The joints move
+ * together, so the move lasts as long as the larger rotation.
+ */
+static double jointTravel(const JointWaypoint& a, const JointWaypoint& b) {
+   const double d1 = fabs(a.j1 - b.j1), d2 = fabs(a.j2 - b.j2);
+   return d1 > d2 ? d1 : d2;
+}
+
+/**
+ * @brief Joint position of a stroke end point, preferring the requested arm.
+ * Points neither arm reaches map to the joint origin; they cannot be drawn,
+ * so where they land in the order does not matter.
+ */
+static JointWaypoint strokeEndJoints(const PathPoint& p, int arm) {
+   JointWaypoint q;
+   if (scaraIK(p.x, p.y, &q.j1, &q.j2, arm) == 0) return q;
+   if (scaraIK(p.x, p.y, &q.j1, &q.j2, arm == LEFT_ARM_SOLUTION ? RIGHT_ARM_SOLUTION : LEFT_ARM_SOLUTION) == 0) return q;
+   q.j1 = q.j2 = 0;
+   return q;
+}
+
+/**
+ * @brief Uniform grid over joint space holding the end points of strokes
+ * not yet ordered. Entries are removed in O(1) by swapping with the last
+ * entry of their cell.
+ */
+class StrokeEndGrid {
+public:
+   StrokeEndGrid(const std::vector<JointWaypoint>& ends) : m_ends(ends), m_slot(ends.size()) {
+      m_size = (int)sqrt((double)ends.size() / 2.0);
+      if (m_size < 1) m_size = 1;
+      if (m_size > 1024) m_size = 1024;
+      m_cell = 2.0 * 180.0 / m_size;
+      m_cells.resize((size_t)m_size * m_size);
+      for (size_t e = 0; e < ends.size(); e++) {
+         std::vector<size_t>& cell = m_cells[CellOf(ends[e])];
+         m_slot[e] = cell.size();
+         cell.push_back(e);
+      }
+   }
+
+   void Remove(size_t e) {
+      std::vector<size_t>& cell = m_cells[CellOf(m_ends[e])];
+      const size_t last = cell.back();
+      cell[m_slot[e]] = last;
+      m_slot[last] = m_slot[e];
+      cell.pop_back();
+   }
+
+   /**
+    * @brief Closest remaining end point to q, searching rings of cells
+    * outwards until no closer point can exist. Returns false if empty.
+    */
+   bool Nearest(const JointWaypoint& q, size_t* found) const {
+      const int cx = Coord(q.j1), cy = Coord(q.j2);
+      double best = 1e300;
+      for (int r = 0; r < m_size; r++) {
+         if (best < (r - 1) * m_cell) break;
+         for (int x = cx - r; x <= cx + r; x++) {
+            if (x < 0 || x >= m_size) continue;
+            const int step = (x == cx - r || x == cx + r) ? 1 : 2 * r;
+            for (int y = cy - r; y <= cy + r; y += step > 0 ? step : 1) {
+               if (y < 0 || y >= m_size) continue;
+               const std::vector<size_t>& cell = m_cells[(size_t)x * m_size + y];
+               for (size_t k = 0; k < cell.size(); k++) {
+                  const double d = jointTravel(q, m_ends[cell[k]]);
+                  if (d < best) {
+                     best = d;
+                     *found = cell[k];
+                  }
+               }
+            }
+         }
+      }
+      return best < 1e300;
+   }
+
+private:
+   int Coord(double angle) const {
+      int c = (int)((angle + 180.0) / m_cell);
+      return c < 0 ? 0 : c >= m_size ? m_size - 1 : c;
+   }
+   size_t CellOf(const JointWaypoint& q) const { return (size_t)Coord(q.j1) * m_size + Coord(q.j2); }
+
+   const std::vector<JointWaypoint>& m_ends; // 2 per stroke: first point, last point
+   std::vector<size_t> m_slot;               // position of each end in its cell
+   std::vector<std::vector<size_t> > m_cells;
+   int m_size;                               // cells per axis
+   double m_cell;                            // cell width in degrees
+};
+
+/**
+ * @brief Pen-up joint travel of drawing strokes in the given order, starting
+ * from start.
+ */
+double strokeTravel (const std::vector<Stroke>& strokes, int arm, JointWaypoint start,
+                     const std::vector<StrokeOrder>& order) {
+   double travel = 0;
+   JointWaypoint at = start;
+   for (size_t k = 0; k < order.size(); k++) {
+      const Stroke& s = strokes[order[k].stroke];
+      if (s.empty()) continue;
+      travel += jointTravel(at, strokeEndJoints(order[k].reversed ? s.back() : s.front(), arm));
+      at = strokeEndJoints(order[k].reversed ? s.front() : s.back(), arm);
+   }
+   return travel;
+}
+
+/**
+ * @brief Chooses the order and direction of strokes to minimise pen-up travel.
+ *
+ * Travel is measured in joint space from scaraIK() solutions of the stroke
+ * end points, since joint rotation is what the simulator spends time on.
+ * A nearest-neighbour tour is built with a grid index over the end points,
+ * then improved by 2-opt: reversing a run of strokes also flips each
+ * stroke's direction, and runs are limited to STROKE_2OPT_WINDOW strokes so
+ * every pass stays linear in the number of strokes.
+ *
+ * @param strokes - Strokes to draw. Empty strokes are skipped.
+ * @param arm - Preferred arm solution for end points.
+ * @param start - Joint position before the first stroke.
+ * @param order - Receives the chosen order. Output
+ *
+ * @return - total pen-up joint travel of the chosen order in degrees
+ */
+double orderStrokes (const std::vector<Stroke>& strokes, int arm, JointWaypoint start,
+                     std::vector<StrokeOrder>* order) {
+   order->clear();
+
+   // End points in joint space: 2k = first point of stroke k, 2k+1 = last
+   std::vector<size_t> ids;
+   std::vector<JointWaypoint> ends;
+   for (size_t k = 0; k < strokes.size(); k++) {
+      if (strokes[k].empty()) continue;
+      ids.push_back(k);
+      ends.push_back(strokeEndJoints(strokes[k].front(), arm));
+      ends.push_back(strokeEndJoints(strokes[k].back(), arm));
+   }
+   const size_t m = ids.size();
+
+   // Nearest-neighbour tour: enter each stroke at its closest end
+   std::vector<size_t> entry; // end point through which each tour stroke is entered
+   StrokeEndGrid grid(ends);
+   JointWaypoint at = start;
+   size_t e;
+   while (grid.Nearest(at, &e)) {
+      const size_t other = e ^ 1;
+      grid.Remove(e);
+      grid.Remove(other);
+      entry.push_back(e);
+      at = ends[other];
+   }
+
+   // 2-opt over runs of strokes; a reversed run is entered through its old exits
+   for (int pass = 0; pass < STROKE_2OPT_PASSES; pass++) {
+      bool improved = false;
+      for (size_t i = 0; i < m; i++) {
+         const JointWaypoint& before = i == 0 ? start : ends[entry[i-1] ^ 1];
+         const JointWaypoint& in = ends[entry[i]];
+         const size_t last = i + STROKE_2OPT_WINDOW < m ? i + STROKE_2OPT_WINDOW : m - 1;
+         for (size_t j = i; j <= last; j++) {
+            const JointWaypoint& out = ends[entry[j] ^ 1];
+            double delta = jointTravel(before, out) - jointTravel(before, in);
+            if (j + 1 < m) {
+               const JointWaypoint& after = ends[entry[j+1]];
+               delta += jointTravel(in, after) - jointTravel(out, after);
+            }
+            if (delta < -1e-9) {
+               std::reverse(entry.begin() + i, entry.begin() + j + 1);
+               for (size_t k = i; k <= j; k++) entry[k] ^= 1;
+               improved = true;
+               break;
+            }
+         }
+      }
+      if (!improved) break;
+   }
+
+   for (size_t k = 0; k < m; k++) {
+      StrokeOrder o = { ids[entry[k] / 2], (entry[k] & 1) != 0 };
+      order->push_back(o);
+   }
+   return strokeTravel(strokes, arm, start, *order);
+}
+
+/*|Arm Configuration|----------------------------------------------------------*/
+
+/**
+ * @brief Chooses the left or right arm solution at every waypoint of a path.
+ *
+ * Both scaraIK() solutions are computed for all points (with the batch
+ * solver), then a two-state Viterbi pass picks the sequence minimising the
+ * total joint travel plus flipPenalty for every change of arm. Solutions
+ * outside the joint limits are never chosen. Runs in O(n).
+ *
+ * @param path - Waypoints in Cartesian space.
+ * @param start - Joint position before the first waypoint, or NULL if free.
+ * @param flipPenalty - Extra cost of switching arm, in degrees of travel.
+ * @param joints - Receives the joint angles of every waypoint. Output
+ * @param arms - Receives LEFT_ARM_SOLUTION or RIGHT_ARM_SOLUTION per waypoint. Output
+ *
+ * @return - number of arm flips, or (-1) if some waypoint is unreachable with either arm
+ */
+int planArmConfigurations (const std::vector<PathPoint>& path, const JointWaypoint* start, double flipPenalty,
+                           std::vector<JointWaypoint>* joints, std::vector<int>* arms) {
+   const size_t n = path.size();
+   joints->clear();
+   arms->clear();
+   if (n == 0) return 0;
+
+   // Both IK solutions for every point
+   std::vector<double> x(n), y(n), j1[2], j2[2];
+   std::vector<signed char> error[2];
+   for (size_t i = 0; i < n; i++) {
+      x[i] = path[i].x;
+      y[i] = path[i].y;
+   }
+   for (int arm = 0; arm < 2; arm++) {
+      j1[arm].resize(n);
+      j2[arm].resize(n);
+      error[arm].resize(n);
+      scaraIKBatch(x.data(), y.data(), j1[arm].data(), j2[arm].data(), error[arm].data(), n, arm);
+   }
+
+   // cost[arm] = cheapest total reaching the current point with that arm
+   const double INFEASIBLE = 1e300;
+   std::vector<unsigned char> from(2 * n);
+   double cost[2];
+   for (int arm = 0; arm < 2; arm++) {
+      cost[arm] = INFEASIBLE;
+      if (error[arm][0] != 0) continue;
+      JointWaypoint q = { j1[arm][0], j2[arm][0] };
+      cost[arm] = start != NULL ? jointTravel(*start, q) : 0;
+   }
+   for (size_t i = 1; i < n; i++) {
+      double next[2];
+      for (int arm = 0; arm < 2; arm++) {
+         next[arm] = INFEASIBLE;
+         if (error[arm][i] != 0) continue;
+         JointWaypoint q = { j1[arm][i], j2[arm][i] };
+         for (int prev = 0; prev < 2; prev++) {
+            if (cost[prev] >= INFEASIBLE) continue;
+            JointWaypoint p = { j1[prev][i-1], j2[prev][i-1] };
+            const double c = cost[prev] + jointTravel(p, q) + (prev != arm ? flipPenalty : 0);
+            if (c < next[arm]) {
+               next[arm] = c;
+               from[2*i + arm] = (unsigned char)prev;
+            }
+         }
+      }
+      if (next[0] >= INFEASIBLE && next[1] >= INFEASIBLE) return -1;
+      cost[0] = next[0];
+      cost[1] = next[1];
+   }
+   if (cost[0] >= INFEASIBLE && cost[1] >= INFEASIBLE) return -1;
+
+   // Walk the back-pointers from the cheaper final state
+   joints->resize(n);
+   arms->resize(n);
+   int arm = cost[RIGHT_ARM_SOLUTION] < cost[LEFT_ARM_SOLUTION] ? RIGHT_ARM_SOLUTION : LEFT_ARM_SOLUTION;
+   int flips = 0;
+   for (size_t i = n; i-- > 0; ) {
+      (*arms)[i] = arm;
+      (*joints)[i].j1 = j1[arm][i];
+      (*joints)[i].j2 = j2[arm][i];
+      if (i > 0) {
+         const int prev = from[2*i + arm];
+         flips += prev != arm;
+         arm = prev;
+      }
+   }
+   return flips;
+}
@@ -0,0 +1,49 @@
+/*|SCARA Motion|---------------------------------------------------------------
+#
+# Path planning on top of the kinematics: turns Cartesian geometry into the
+# joint-space waypoints that become ROTATE_JOINT commands. The simulator
+# interpolates joints linearly between commands, so every waypoint saved is
+# one command fewer on the wire.
+# -----------------------------------------------------------------------------*/
+#ifndef _SCARA_MOTION_H_
+#define _SCARA_MOTION_H_
+
+#include <vector>
+#include "scara_kinematics.h"
+
+/*|CONSTANTS|------------------------------------------------------------------*/
+#define DEFAULT_LINE_TOLERANCE   0.5  // mm the traced path may stray from a line
+#define MIN_LINE_TOLERANCE       0.01 // mm; finer line tolerances are raised to this
+#define MAX_LINE_SUBDIVISION     24   // bisection depth limit for one line
+#define LINE_BAD_TOLERANCE       (-3) // planLinearMove error: tolerance not positive; scaraIK uses -1 and -2
+#define STROKE_2OPT_WINDOW       48   // strokes looked ahead by each 2-opt move
+#define STROKE_2OPT_PASSES       8    // 2-opt sweeps over the whole order
+#define DEFAULT_FLIP_PENALTY     90.0 // degrees of travel an elbow flip is worth avoiding
+
+/*|Types|----------------------------------------------------------------------*/
+struct JointWaypoint {
+   double j1; // degrees
+   double j2; // degrees
+};
+
+struct PathPoint {
+   double x; // mm
+   double y; // mm
+};
+
+typedef std::vector<PathPoint> Stroke; // drawn pen-down, first to last point
+
+struct StrokeOrder {
+   size_t stroke;  // index into the input strokes
+   bool reversed;  // draw last point to first
+};
+
+/*|Function Prototypes|--------------------------------------------------------*/
+int planLinearMove (double, double, double, double, int, double, std::vector<JointWaypoint>*);
+size_t simplifyPath (std::vector<PathPoint>*, double);
+double orderStrokes (const std::vector<Stroke>&, int, JointWaypoint, std::vector<StrokeOrder>*);
+double strokeTravel (const std::vector<Stroke>&, int, JointWaypoint, const std::vector<StrokeOrder>&);
+int planArmConfigurations (const std::vector<PathPoint>&, const JointWaypoint*, double,
+                           std::vector<JointWaypoint>*, std::vector<int>*);
+
+#endif
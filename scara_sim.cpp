@@ -0,0 +1,128 @@
+#include <cmath>
+#include "scara_sim.h"
+#include "scara_kinematics.h"
+using namespace openutils;
+
+CScaraSimulator::CScaraSimulator(FILE* errorLog)
+{
+   m_errorLog = errorLog;
+   Reset();
+}
+
+void CScaraSimulator::Reset()
+{
+   m_j1 = 0;
+   m_j2 = 0;
+   m_bPenDown = false;
+   m_r = 0; m_g = 0; m_b = 255;
+   m_bCycleColors = false;
+   m_bProcessMessages = true;
+   m_speed = MOTOR_SPEED_HIGH;
+   m_trace.clear();
+   m_parser.Reset();
+   m_nCommands = 0;
+   m_nErrors = 0;
+   m_bEnded = false;
+   m_bShutdown = false;
+}
+
+void CScaraSimulator::BeginSession()
+{
+   m_parser.Reset();
+   m_bEnded = false;
+}
+
+/**
+* Executes every complete line in data. A trailing partial line is kept
+* and completed by the next call, like the simulator's socket reader.
+* Returns the number of lines executed or rejected.
+* @param data Received bytes
+* @param len Number of bytes
+*/
+int CScaraSimulator::Feed(const char* data,int len)
+{
+   CParsedCommand cmd;
+   int lines = 0;
+   m_parser.Feed(data,len);
+   while(m_parser.Next(&cmd))
+   {
+      Apply(cmd);
+      lines++;
+   }
+   return lines;
+}
+
+/**
+* Executes one command line (without its '\n'). Blank lines are ignored.
+* Returns 0, or -1 if the command was rejected and logged.
+* @param line Command text
+* @param len Number of bytes
+*/
+int CScaraSimulator::Execute(const char* line,int len)
+{
+   CParsedCommand cmd;
+   if(len > 0 && line[len-1] == '\r') len--;
+   int i = 0;
+   while(i < len && (line[i] == ' ' || line[i] == '\t')) i++;
+   if(i >= len) return 0;
+   CCommandParser::ParseLine(line,len,&cmd);
+   return Apply(cmd);
+}
+
+int CScaraSimulator::Apply(const CParsedCommand& cmd)
+{
+   if(cmd.error != PARSE_OK) return Reject(CCommandParser::GetErrorText(cmd.error),cmd.line);
+
+   switch(cmd.type)
+   {
+      case CMD_ROTATE_JOINT:
+         if(fabs(cmd.ang1) > Lab07Arm::MAX_THETA1_DEG || fabs(cmd.ang2) > Lab07Arm::MAX_THETA2_DEG)
+            return Reject("Joint Angle Out Of Range!",cmd.line);
+         Move(cmd.ang1,cmd.ang2);
+         break;
+      case CMD_PEN_UP: m_bPenDown = false; break;
+      case CMD_PEN_DOWN: m_bPenDown = true; break;
+      case CMD_PEN_COLOR:
+         m_r = (unsigned char)cmd.r; m_g = (unsigned char)cmd.g; m_b = (unsigned char)cmd.b;
+         break;
+      case CMD_CYCLE_PEN_COLORS: m_bCycleColors = cmd.on; break;
+      case CMD_PROCESS_MESSAGES: m_bProcessMessages = cmd.on; break;
+      case CMD_MOTOR_SPEED: m_speed = cmd.speed; break;
+      case CMD_MESSAGE: break; // headless: nothing to display
+      case CMD_CLEAR_TRACE: m_trace.clear(); break;
+      case CMD_CLEAR_REMOTE_COMMAND_LOG: break;
+      case CMD_CLEAR_POSITION_LOG: break;
+      case CMD_HOME: Move(0,0); break;
+      case CMD_END: m_bEnded = true; break;
+      case CMD_SHUTDOWN_SIMULATION: m_bShutdown = true; break;
+   }
+
+   m_nCommands++;
+   return 0;
+}
+
+/**
+* Writes a rejected command to the error log in the simulator's format.
+*/
+int CScaraSimulator::Reject(const char* error,const CTextView& line)
+{
+   m_nErrors++;
+   if(m_errorLog != NULL)
+   {
+      fprintf(m_errorLog,"\nError: %s\nCommand was: %.*s\n",error,line.length,line.data);
+      fflush(m_errorLog);
+   }
+   return -1;
+}
+
+void CScaraSimulator::Move(double j1,double j2)
+{
+   m_j1 = j1;
+   m_j2 = j2;
+   if(!m_bPenDown) return;
+
+   CTracePoint point;
+   scaraFK(j1,j2,&point.x,&point.y);
+   point.r = m_r; point.g = m_g; point.b = m_b;
+   m_trace.push_back(point);
+}
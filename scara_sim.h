@@ -0,0 +1,62 @@
+#ifndef _SCARA_SIM_H_
+#define _SCARA_SIM_H_
+
+#include <cstdio>
+#include <vector>
+using namespace std;
+#include "command_parser.h"
+
+namespace openutils
+{
+   /// One pen-down point of the simulator trace.
+   struct CTracePoint
+   {
+      double x,y; /// tool position in mm
+      unsigned char r,g,b; /// pen colour
+   };
+
+   /**
+   * Headless model of ScaraRobotSim: executes the commands listed in
+   * "robot commands.txt", keeps joint, pen and colour state plus the pen
+   * trace, and logs rejected commands in the simulator's "error log.txt"
+   * format. Motion is instantaneous, so it measures protocol cost only.
+   */
+   class CScaraSimulator
+   {
+   private:
+      double m_j1,m_j2; /// joint angles in degrees
+      bool m_bPenDown; /// pen state
+      unsigned char m_r,m_g,m_b; /// pen colour
+      bool m_bCycleColors; /// CYCLE_PEN_COLORS state
+      bool m_bProcessMessages; /// PROCESS_MESSAGES state
+      MotorSpeed m_speed; /// MOTOR_SPEED state
+      vector<CTracePoint> m_trace; /// pen-down positions since CLEAR_TRACE
+      FILE* m_errorLog; /// where rejected commands are written, may be NULL
+      CCommandParser m_parser; /// splits received bytes into commands
+      long m_nCommands; /// commands executed
+      long m_nErrors; /// commands rejected
+      bool m_bEnded; /// END received
+      bool m_bShutdown; /// SHUTDOWN_SIMULATION received
+   public:
+      CScaraSimulator(FILE* errorLog = NULL); /// Starts at home with the pen up
+      int Feed(const char* data,int len); /// Executes every complete line, returns lines seen
+      int Execute(const char* line,int len); /// Executes one command line, returns 0 or -1
+      void Reset(); /// Returns to the power-on state
+      void BeginSession(); /// Prepares for a new client, keeping arm state and trace
+      double GetJ1() { return m_j1; } /// Returns joint 1 in degrees
+      double GetJ2() { return m_j2; } /// Returns joint 2 in degrees
+      bool IsPenDown() { return m_bPenDown; } /// Returns the pen state
+      MotorSpeed GetSpeed() { return m_speed; } /// Returns the motor speed
+      const vector<CTracePoint>& GetTrace() { return m_trace; } /// Returns the pen trace
+      long GetCommandCount() { return m_nCommands; } /// Returns commands executed
+      long GetErrorCount() { return m_nErrors; } /// Returns commands rejected
+      bool IsEnded() { return m_bEnded; } /// True once END was received
+      bool IsShutdown() { return m_bShutdown; } /// True once SHUTDOWN_SIMULATION was received
+   private:
+      int Apply(const CParsedCommand& cmd); /// Executes a parsed command, returns 0 or -1
+      int Reject(const char* error,const CTextView& line); /// Logs a rejected command
+      void Move(double j1,double j2); /// Moves the arm, tracing if the pen is down
+   };
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*|SCARA Simulator Stand-in|---------------------------------------------------
+#
+# Headless replacement for ScaraRobotSim.exe in remote mode. Listens on the
+# simulator port, executes every command it receives with CScaraSimulator
+# and appends rejected commands to an error log in the simulator's format.
+# Motion is instantaneous, so the server is also the throughput baseline
+# for the client transport. Clients are served concurrently from one
+# CEventLoop, each with its own simulated arm.
+#
+# Usage: scara_sim_server [-p port] [-a] [-l error_log] [-q]
+#   -p port       port to listen on (default 1270)
+#   -a            acknowledge every command with a newline, for PACING_WINDOW
+#   -l error_log  error log path (default "error log.txt")
+#   -q            do not print per-session statistics
+# -----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <unordered_map>
+#include "robot.h"
+#include "event_loop.h"
+#include "scara_sim.h"
+
+#define RECV_BUFFER 65536
+
+/// One connected client and the arm it drives.
+struct Session {
+   CScaraSimulator sim;
+   std::chrono::steady_clock::time_point start;
+   Session(FILE* errorLog) : sim(errorLog), start(std::chrono::steady_clock::now()) {}
+};
+
+int main(int argc, char** argv) {
+   int port = PORT;
+   bool ack = false, quiet = false;
+   const char* logPath = "error log.txt";
+   for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) port = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) logPath = argv[++i];
+      else if (strcmp(argv[i], "-a") == 0) ack = true;
+      else if (strcmp(argv[i], "-q") == 0) quiet = true;
+      else {
+         fprintf(stderr, "usage: %s [-p port] [-a] [-l error_log] [-q]\n", argv[0]);
+         return 1;
+      }
+   }
+
+   FILE* errorLog = fopen(logPath, "a");
+   if (errorLog == NULL) {
+      fprintf(stderr, "cannot open %s\n", logPath);
+      return 1;
+   }
+
+   CWinSock::Initialize();
+   static char buffer[RECV_BUFFER];
+   static char acks[RECV_BUFFER];
+   memset(acks, '\n', sizeof(acks));
+
+   try {
+      CServerSocket server(port, SOMAXCONN);
+      CEventLoop loop;
+      std::unordered_map<CRobot*, Session*> sessions;
+
+      auto onClient = [&](CRobot* client, int events) {
+         Session* session = sessions[client];
+         CScaraSimulator& sim = session->sim;
+         bool done = (events & EVENT_CLOSED) != 0;
+         try {
+            // One read per wakeup; the loop calls again while data remains
+            int nread = client->ReadAvailable(buffer, RECV_BUFFER);
+            int lines = sim.Feed(buffer, nread);
+            if (ack && lines > 0) client->Post(acks, lines);
+         } catch (CSocketException& e) {
+            if (e.GetCode() != 0) fprintf(stderr, "client error %d: %s\n", e.GetCode(), e.GetMessage());
+            done = true;
+         }
+         if (!done && !sim.IsEnded() && !sim.IsShutdown()) return;
+
+         double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - session->start).count();
+         if (!quiet) {
+            printf("session: %ld commands in %.3f s (%.0f commands/s), %ld errors, %zu trace points\n",
+                   sim.GetCommandCount(), seconds, seconds > 0 ? sim.GetCommandCount() / seconds : 0.0,
+                   sim.GetErrorCount(), sim.GetTrace().size());
+         }
+         if (sim.IsShutdown()) loop.Stop();
+         loop.Remove(client);
+         sessions.erase(client);
+         delete session;
+         delete client;
+      };
+
+      loop.Add(&server, [&](CRobot* client) {
+         CWinSock::Initialize(); // balances the Finalize() in the client's Close()
+         client->SetPacing(PACING_NONE);
+         sessions[client] = new Session(errorLog);
+         loop.Add(client, onClient);
+      });
+      printf("SCARA simulator stand-in listening on port %d (%s)\n", port, CEventLoop::GetBackend());
+      loop.Run();
+   } catch (CSocketException& e) {
+      fprintf(stderr, "server error %d: %s\n", e.GetCode(), e.GetMessage());
+   }
+
+   fclose(errorLog);
+   CWinSock::Finalize();
+   return 0;
+}
@@ -0,0 +1,184 @@
+/*|SCARA SIMD|-----------------------------------------------------------------
+#
+# Minimal portable SIMD layer for the batch kinematics. Kernels are written
+# once as templates over a lane type V and instantiated for:
+#   - double       scalar fallback and loop tails (mask type: bool)
+#   - F64x2        SSE2, 2 lanes (always available on x86-64)
+#   - F64x4        AVX2, 4 lanes (when compiled with -mavx2)
+# Each lane type supports + - * /, comparisons returning its mask type, and
+# the free functions below (vselect, vabs, vsqrt, ...).
+# -----------------------------------------------------------------------------*/
+#ifndef _SCARA_SIMD_H_
+#define _SCARA_SIMD_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define SCARA_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define SCARA_SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace scara_simd {
+
+/*|Scalar|---------------------------------------------------------------------*/
+template <class V> struct Lanes { enum { WIDTH = 1 }; };
+
+inline double vload(const double* p, double) { return *p; }
+inline void vstore(double* p, double v) { *p = v; }
+inline double vselect(bool m, double a, double b) { return m ? a : b; }
+inline double vabs(double v) { return fabs(v); }
+inline double vsqrt(double v) { return sqrt(v); }
+inline double vmax(double a, double b) { return a > b ? a : b; }
+inline double vround(double v) { return nearbyint(v); }
+inline bool vany(bool m) { return m; }
+
+#ifdef SCARA_SIMD_SSE2
+/*|SSE2|-----------------------------------------------------------------------*/
+struct M64x2 { __m128d m; };
+struct F64x2 {
+   __m128d v;
+   F64x2() {}
+   F64x2(__m128d x) : v(x) {}
+   F64x2(double x) : v(_mm_set1_pd(x)) {}
+};
+template <> struct Lanes<F64x2> { enum { WIDTH = 2 }; };
+
+inline F64x2 operator+(F64x2 a, F64x2 b) { return _mm_add_pd(a.v, b.v); }
+inline F64x2 operator-(F64x2 a, F64x2 b) { return _mm_sub_pd(a.v, b.v); }
+inline F64x2 operator*(F64x2 a, F64x2 b) { return _mm_mul_pd(a.v, b.v); }
+inline F64x2 operator/(F64x2 a, F64x2 b) { return _mm_div_pd(a.v, b.v); }
+inline F64x2 operator-(F64x2 a) { return _mm_xor_pd(a.v, _mm_set1_pd(-0.0)); }
+inline M64x2 operator<(F64x2 a, F64x2 b) { M64x2 r = { _mm_cmplt_pd(a.v, b.v) }; return r; }
+inline M64x2 operator>(F64x2 a, F64x2 b) { M64x2 r = { _mm_cmpgt_pd(a.v, b.v) }; return r; }
+inline M64x2 operator<=(F64x2 a, F64x2 b) { M64x2 r = { _mm_cmple_pd(a.v, b.v) }; return r; }
+inline M64x2 operator>=(F64x2 a, F64x2 b) { M64x2 r = { _mm_cmpge_pd(a.v, b.v) }; return r; }
+inline M64x2 operator==(F64x2 a, F64x2 b) { M64x2 r = { _mm_cmpeq_pd(a.v, b.v) }; return r; }
+inline M64x2 operator&&(M64x2 a, M64x2 b) { M64x2 r = { _mm_and_pd(a.m, b.m) }; return r; }
+inline M64x2 operator||(M64x2 a, M64x2 b) { M64x2 r = { _mm_or_pd(a.m, b.m) }; return r; }
+inline M64x2 operator!(M64x2 a) { M64x2 r = { _mm_xor_pd(a.m, _mm_castsi128_pd(_mm_set1_epi32(-1))) }; return r; }
+
+inline F64x2 vload(const double* p, F64x2) { return _mm_loadu_pd(p); }
+inline void vstore(double* p, F64x2 v) { _mm_storeu_pd(p, v.v); }
+inline F64x2 vselect(M64x2 m, F64x2 a, F64x2 b) { return _mm_or_pd(_mm_and_pd(m.m, a.v), _mm_andnot_pd(m.m, b.v)); }
+inline F64x2 vabs(F64x2 v) { return _mm_andnot_pd(_mm_set1_pd(-0.0), v.v); }
+inline F64x2 vsqrt(F64x2 v) { return _mm_sqrt_pd(v.v); }
+inline F64x2 vmax(F64x2 a, F64x2 b) { return _mm_max_pd(a.v, b.v); }
+// Round to nearest even with the 2^52 + 2^51 trick; valid for |v| < 2^51
+inline F64x2 vround(F64x2 v) {
+   const __m128d magic = _mm_set1_pd(6755399441055744.0);
+   return _mm_sub_pd(_mm_add_pd(v.v, magic), magic);
+}
+inline bool vany(M64x2 m) { return _mm_movemask_pd(m.m) != 0; }
+#endif
+
+#ifdef SCARA_SIMD_AVX2
+/*|AVX2|-----------------------------------------------------------------------*/
+struct M64x4 { __m256d m; };
+struct F64x4 {
+   __m256d v;
+   F64x4() {}
+   F64x4(__m256d x) : v(x) {}
+   F64x4(double x) : v(_mm256_set1_pd(x)) {}
+};
+template <> struct Lanes<F64x4> { enum { WIDTH = 4 }; };
+
+inline F64x4 operator+(F64x4 a, F64x4 b) { return _mm256_add_pd(a.v, b.v); }
+inline F64x4 operator-(F64x4 a, F64x4 b) { return _mm256_sub_pd(a.v, b.v); }
+inline F64x4 operator*(F64x4 a, F64x4 b) { return _mm256_mul_pd(a.v, b.v); }
+inline F64x4 operator/(F64x4 a, F64x4 b) { return _mm256_div_pd(a.v, b.v); }
+inline F64x4 operator-(F64x4 a) { return _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)); }
+inline M64x4 operator<(F64x4 a, F64x4 b) { M64x4 r = { _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ) }; return r; }
+inline M64x4 operator>(F64x4 a, F64x4 b) { M64x4 r = { _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ) }; return r; }
+inline M64x4 operator<=(F64x4 a, F64x4 b) { M64x4 r = { _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ) }; return r; }
+inline M64x4 operator>=(F64x4 a, F64x4 b) { M64x4 r = { _mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ) }; return r; }
+inline M64x4 operator==(F64x4 a, F64x4 b) { M64x4 r = { _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ) }; return r; }
+inline M64x4 operator&&(M64x4 a, M64x4 b) { M64x4 r = { _mm256_and_pd(a.m, b.m) }; return r; }
+inline M64x4 operator||(M64x4 a, M64x4 b) { M64x4 r = { _mm256_or_pd(a.m, b.m) }; return r; }
+inline M64x4 operator!(M64x4 a) { M64x4 r = { _mm256_xor_pd(a.m, _mm256_castsi256_pd(_mm256_set1_epi32(-1))) }; return r; }
+
+inline F64x4 vload(const double* p, F64x4) { return _mm256_loadu_pd(p); }
+inline void vstore(double* p, F64x4 v) { _mm256_storeu_pd(p, v.v); }
+inline F64x4 vselect(M64x4 m, F64x4 a, F64x4 b) { return _mm256_blendv_pd(b.v, a.v, m.m); }
+inline F64x4 vabs(F64x4 v) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), v.v); }
+inline F64x4 vsqrt(F64x4 v) { return _mm256_sqrt_pd(v.v); }
+inline F64x4 vmax(F64x4 a, F64x4 b) { return _mm256_max_pd(a.v, b.v); }
+inline F64x4 vround(F64x4 v) { return _mm256_round_pd(v.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+inline bool vany(M64x4 m) { return _mm256_movemask_pd(m.m) != 0; }
+#endif
+
+/*|Math|-----------------------------------------------------------------------*/
+const double SIMD_PI = 3.14159265358979323846;
+
+/**
+ * @brief atan2(y, x) for every lane. Reduces to atan(t) with t in [0, 1],
+ * then to |t| <= 0.66 (Cephes), and evaluates a rational approximation
+ * accurate to about 1e-16 rad. Returns 0 where x and y are both zero.
+ */
+template <class V>
+inline V vatan2(V y, V x) {
+   const V zero(0.0), one(1.0);
+   V ax = vabs(x), ay = vabs(y);
+   auto swap = ay > ax;
+   V num = vselect(swap, ax, ay);
+   V den = vselect(swap, ay, ax);
+   V t = vselect(den == zero, zero, num / den);
+
+   // atan(t) = pi/4 + atan((t - 1) / (t + 1)) for t > 0.66
+   auto upper = t > V(0.66);
+   V u = vselect(upper, (t - one) / (t + one), t);
+   V z = u * u;
+   V p = (((V(-8.750608600031904122785e-1) * z + V(-1.615753718733365076637e1)) * z
+          + V(-7.500855792314704667340e1)) * z + V(-1.228866684490136173410e2)) * z
+          + V(-6.485021904942025371773e1);
+   V q = ((((z + V(2.485846490142306297962e1)) * z + V(1.650270098316988542046e2)) * z
+          + V(4.328810604912902668951e2)) * z + V(4.853903996359136964868e2)) * z
+          + V(1.945506571482613964425e2);
+   V r = u + u * z * p / q;
+   r = vselect(upper, r + V(SIMD_PI / 4.0), r);
+
+   r = vselect(swap, V(SIMD_PI / 2.0) - r, r);
+   r = vselect(x < zero, V(SIMD_PI) - r, r);
+   return vselect(y < zero, -r, r);
+}
+
+/**
+ * @brief sin(x) and cos(x) for every lane. Reduces x by multiples of pi/2
+ * (two-constant Cody-Waite, accurate for the |x| < 100 rad the arm can
+ * produce) and evaluates the Cephes polynomials on [-pi/4, pi/4].
+ */
+template <class V>
+inline void vsincos(V x, V* s, V* c) {
+   const V k = vround(x * V(2.0 / SIMD_PI));
+   const V r = (x - k * V(1.57079632679489655800e+00)) - k * V(6.12323399573676603587e-17);
+   const V z = r * r;
+
+   V sinPoly = ((((V(1.58962301576546568060e-10) * z + V(-2.50507477628578072866e-8)) * z
+               + V(2.75573136213857245213e-6)) * z + V(-1.98412698295895385996e-4)) * z
+               + V(8.33333333332211858878e-3)) * z + V(-1.66666666666666307295e-1);
+   V cosPoly = ((((V(-1.13585365213876817300e-11) * z + V(2.08757008419747316778e-9)) * z
+               + V(-2.75573141792967388112e-7)) * z + V(2.48015872888517045348e-5)) * z
+               + V(-1.38888888888730564116e-3)) * z + V(4.16666666666665929218e-2);
+   V sr = r + r * z * sinPoly;
+   V cr = V(1.0) - V(0.5) * z + z * z * cosPoly;
+
+   // Quadrant k mod 4 from the fractional part of k/4: 0, 0.25, +/-0.5, -0.25
+   V f = k * V(0.25) - vround(k * V(0.25));
+   auto q1 = f == V(0.25);
+   auto q2 = vabs(f) == V(0.5);
+   auto q3 = f == V(-0.25);
+   auto odd = q1 || q3;
+   V sv = vselect(odd, cr, sr);
+   V cv = vselect(odd, sr, cr);
+   *s = vselect(q2 || q3, -sv, sv);
+   *c = vselect(q1 || q2, -cv, cv);
+}
+
+} // namespace scara_simd
+
+#endif
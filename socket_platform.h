@@ -0,0 +1,142 @@
+#ifndef _SOCKET_PLATFORM_H_
+#define _SOCKET_PLATFORM_H_
+
+/*
+* Socket backend selection. The networking code is written against the
+* Winsock names it was born with; on POSIX systems this header maps those
+* names onto BSD sockets, so robot.cpp and event_loop.cpp compile unchanged
+* on both. Only the calls that differ in behaviour (blocking mode, waiting
+* on a socket) get a wrapper of their own.
+*/
+
+#ifdef _WIN32
+
+#ifndef FD_SETSIZE
+#define FD_SETSIZE 1024 /// sockets one select() can watch (Winsock default is 64)
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+
+#define SOCKET_SEND_FLAGS  0 /// flags passed to every send()
+
+#pragma warning (disable : 4996)
+#pragma warning (disable : 4290)
+#pragma comment(lib,"ws2_32")
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+
+typedef int SOCKET;
+typedef struct sockaddr_in SOCKADDR_IN;
+typedef struct sockaddr* LPSOCKADDR;
+typedef struct hostent HOSTENT;
+typedef struct hostent* LPHOSTENT;
+typedef struct in_addr* LPIN_ADDR;
+
+#define INVALID_SOCKET   (-1)
+#define SOCKET_ERROR     (-1)
+#define WSAEWOULDBLOCK   EWOULDBLOCK
+#define WSAEINPROGRESS   EINPROGRESS
+#define WSAEINTR         EINTR
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+// A peer that has gone away must surface as an error, not as SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define SOCKET_SEND_FLAGS  MSG_NOSIGNAL
+#else
+#define SOCKET_SEND_FLAGS  0
+#endif
+
+inline int WSAGetLastError() { return errno; }
+inline int closesocket(SOCKET s) { return close(s); }
+
+inline void Sleep(unsigned long ms)
+{
+   struct timespec ts;
+   ts.tv_sec = ms / 1000;
+   ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+   while(nanosleep(&ts,&ts) == -1 && errno == EINTR) { }
+}
+
+#endif
+
+namespace openutils
+{
+   /**
+   * Switches a socket between blocking and non-blocking mode.
+   * Returns false on failure.
+   */
+   inline bool SetSocketBlocking(SOCKET s,bool blocking)
+   {
+#ifdef _WIN32
+      u_long nonBlocking = blocking ? 0 : 1;
+      return ioctlsocket(s,FIONBIO,&nonBlocking) == 0;
+#else
+      int flags = fcntl(s,F_GETFL,0);
+      if(flags == -1) return false;
+      flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+      return fcntl(s,F_SETFL,flags) == 0;
+#endif
+   }
+
+   /**
+   * Returns true if the last socket call failed only because a
+   * non-blocking socket had nothing to offer.
+   */
+   inline bool SocketWouldBlock(int error)
+   {
+#ifdef _WIN32
+      return error == WSAEWOULDBLOCK;
+#else
+      return error == EWOULDBLOCK || error == EAGAIN;
+#endif
+   }
+
+   /**
+   * Waits up to timeout ms (-1 for ever) until s is readable, or writable
+   * if write is true. Returns 1 when ready, 0 on timeout, SOCKET_ERROR on
+   * failure. The POSIX backend uses poll(), so descriptors above
+   * FD_SETSIZE are fine there.
+   */
+   inline int WaitSocket(SOCKET s,bool write,int timeout)
+   {
+#ifdef _WIN32
+      fd_set set;
+      timeval tv;
+      FD_ZERO(&set);
+      FD_SET(s,&set);
+      tv.tv_sec = timeout / 1000;
+      tv.tv_usec = (timeout % 1000) * 1000;
+      int nret = select((int)s + 1,write ? NULL : &set,write ? &set : NULL,NULL,timeout < 0 ? NULL : &tv);
+      return nret > 0 ? 1 : nret;
+#else
+      struct pollfd pfd;
+      pfd.fd = s;
+      pfd.events = write ? POLLOUT : POLLIN;
+      pfd.revents = 0;
+      int nret;
+      do
+      {
+         nret = poll(&pfd,1,timeout);
+      } while(nret == -1 && errno == EINTR);
+      return nret > 0 ? 1 : nret;
+#endif
+   }
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#define CACHE_LINE_SIZE 64
+
+namespace openutils
+{
+   /**
+   * Fixed-capacity lock-free ring for exactly one producer thread and one
+   * consumer thread. Head and tail live on separate cache lines, and each
+   * side keeps a private copy of the other side's index so the shared line
+   * is only re-read when the ring looks full (producer) or empty (consumer).
+   * Capacity must be a power of two. CRobot's async send queue does not
+   * use it: Enqueue() may be called from any thread and blocks while the
+   * queue is full, which a single-producer ring cannot provide.
+   */
+   template <typename T,size_t Capacity>
+   class CSpscRing
+   {
+      static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,"Capacity must be a power of two");
+
+   private:
+      struct CPaddedIndex
+      {
+         std::atomic<size_t> value; /// shared index
+         size_t cached; /// owner's copy of the opposite index
+         char pad[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+      };
+
+      char m_padFront[CACHE_LINE_SIZE]; /// keeps m_head off the previous object's line
+      CPaddedIndex m_head; /// next slot to read, written by the consumer
+      CPaddedIndex m_tail; /// next slot to write, written by the producer
+      std::unique_ptr<T[]> m_slots; /// record storage
+
+   public:
+      CSpscRing() : m_slots(new T[Capacity])
+      {
+         m_head.value.store(0,std::memory_order_relaxed);
+         m_head.cached = 0;
+         m_tail.value.store(0,std::memory_order_relaxed);
+         m_tail.cached = 0;
+      }
+
+      CSpscRing(const CSpscRing&) = delete;
+      CSpscRing& operator = (const CSpscRing&) = delete;
+
+      static size_t GetCapacity() { return Capacity; } /// Returns the number of slots
+
+      /// Producer: copies item into the ring. Returns false if the ring is full.
+      bool TryPush(const T& item)
+      {
+         size_t tail = m_tail.value.load(std::memory_order_relaxed);
+         if(tail - m_tail.cached == Capacity)
+         {
+            m_tail.cached = m_head.value.load(std::memory_order_acquire);
+            if(tail - m_tail.cached == Capacity) return false;
+         }
+         m_slots[tail & (Capacity - 1)] = item;
+         m_tail.value.store(tail + 1,std::memory_order_release);
+         return true;
+      }
+
+      /// Consumer: moves the oldest item into out. Returns false if the ring is empty.
+      bool TryPop(T& out)
+      {
+         return PopBatch(&out,1) == 1;
+      }
+
+      /**
+      * Consumer: exposes up to max readable items as one contiguous span
+      * without copying them. The span stops at the physical end of the
+      * storage, so a wrapped ring needs a second call after Consume().
+      * Returns the number of items available at *first.
+      */
+      size_t Peek(const T** first,size_t max)
+      {
+         size_t head = m_head.value.load(std::memory_order_relaxed);
+         size_t available = m_head.cached - head;
+         if(available == 0)
+         {
+            m_head.cached = m_tail.value.load(std::memory_order_acquire);
+            available = m_head.cached - head;
+            if(available == 0) return 0;
+         }
+         size_t index = head & (Capacity - 1);
+         if(available > Capacity - index) available = Capacity - index;
+         if(available > max) available = max;
+         *first = &m_slots[index];
+         return available;
+      }
+
+      /// Consumer: releases n items previously returned by Peek().
+      void Consume(size_t n)
+      {
+         m_head.value.store(m_head.value.load(std::memory_order_relaxed) + n,std::memory_order_release);
+      }
+
+      /**
+      * Consumer: copies up to max items into out and releases them with a
+      * single index update, across the wrap point too, so a writer can
+      * gather many records for one send(). Returns the number of items
+      * copied.
+      */
+      size_t PopBatch(T* out,size_t max)
+      {
+         size_t head = m_head.value.load(std::memory_order_relaxed);
+         size_t available = m_head.cached - head;
+         if(available < max)
+         {
+            m_head.cached = m_tail.value.load(std::memory_order_acquire);
+            available = m_head.cached - head;
+         }
+         if(available > max) available = max;
+         if(available == 0) return 0;
+         for(size_t i = 0; i < available; i++)
+            out[i] = m_slots[(head + i) & (Capacity - 1)];
+         m_head.value.store(head + available,std::memory_order_release);
+         return available;
+      }
+
+      /// Approximate number of queued items; exact only on the owning threads.
+      size_t GetSize()
+      {
+         return m_tail.value.load(std::memory_order_acquire) - m_head.value.load(std::memory_order_acquire);
+      }
+   };
+}
+
+#endif
@@ -0,0 +1,358 @@
+#include <cstdlib>
+#include <cstring>
+#include "uring_writer.h"
+#ifdef SCARA_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+using namespace openutils;
+
+#ifdef SCARA_HAVE_IO_URING
+// liburing is not a dependency; these are the three raw system calls it wraps
+static int uringSetup(unsigned entries,io_uring_params* params)
+{
+   return (int)syscall(__NR_io_uring_setup,entries,params);
+}
+
+static int uringEnter(int fd,unsigned submit,unsigned minComplete,unsigned flags)
+{
+   int nret;
+   do
+   {
+      nret = (int)syscall(__NR_io_uring_enter,fd,submit,minComplete,flags,NULL,0);
+   } while(nret == -1 && errno == EINTR);
+   return nret;
+}
+
+static int uringRegister(int fd,unsigned opcode,void* arg,unsigned count)
+{
+   return (int)syscall(__NR_io_uring_register,fd,opcode,arg,count);
+}
+#endif
+
+CUringWriter::CUringWriter(CRobot* robot)
+{
+   m_robot = robot;
+   m_ringFd = -1;
+   m_sqRing = m_cqRing = m_sqes = m_cqes = NULL;
+   m_nSqRingSize = m_nCqRingSize = m_nSqesSize = 0;
+   m_buffers = NULL;
+   m_nFill = -1;
+   m_nQueued = 0;
+   m_nChainSize = 0;
+   m_nChain = 0;
+   m_bZeroCopy = false;
+   m_nSubmits = 0;
+   memset(m_slots,0,sizeof(m_slots));
+}
+
+CUringWriter::~CUringWriter()
+{
+   try
+   {
+      Flush();
+   }
+   catch(CSocketException&)
+   {
+   }
+   Close();
+}
+
+/**
+* Creates the ring and maps it. With zeroCopy, registers the send buffers
+* and uses IORING_OP_SEND_ZC if the kernel supports it; otherwise plain
+* IORING_OP_SEND is used. Returns false if io_uring cannot be used, in
+* which case Write() falls back to blocking send().
+* @param zeroCopy Try zero-copy sends from registered buffers
+*/
+bool CUringWriter::Open(bool zeroCopy)
+{
+#ifdef SCARA_HAVE_IO_URING
+   if(IsOpen()) return true;
+   io_uring_params params;
+   memset(&params,0,sizeof(params));
+   int fd = uringSetup(URING_QUEUE_DEPTH,&params);
+   if(fd < 0) return false;
+
+   m_nSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+   m_nCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+   if(params.features & IORING_FEAT_SINGLE_MMAP)
+   {
+      if(m_nCqRingSize > m_nSqRingSize) m_nSqRingSize = m_nCqRingSize;
+      m_nCqRingSize = 0;
+   }
+   m_nSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+   m_sqRing = mmap(NULL,m_nSqRingSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_SQ_RING);
+   m_cqRing = m_nCqRingSize == 0 ? m_sqRing
+            : mmap(NULL,m_nCqRingSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_CQ_RING);
+   m_sqes = mmap(NULL,m_nSqesSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_SQES);
+   void* buffers = NULL;
+   if(m_sqRing == MAP_FAILED || m_cqRing == MAP_FAILED || m_sqes == MAP_FAILED
+      || posix_memalign(&buffers,4096,(size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE) != 0)
+   {
+      if(m_sqRing != MAP_FAILED) munmap(m_sqRing,m_nSqRingSize);
+      if(m_nCqRingSize != 0 && m_cqRing != MAP_FAILED) munmap(m_cqRing,m_nCqRingSize);
+      if(m_sqes != MAP_FAILED) munmap(m_sqes,m_nSqesSize);
+      m_sqRing = m_cqRing = m_sqes = NULL;
+      close(fd);
+      return false;
+   }
+   m_ringFd = fd;
+   m_buffers = (char*)buffers;
+
+   char* sq = (char*)m_sqRing;
+   char* cq = (char*)m_cqRing;
+   m_sqHead = (unsigned*)(sq + params.sq_off.head);
+   m_sqTail = (unsigned*)(sq + params.sq_off.tail);
+   m_sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+   m_sqArray = (unsigned*)(sq + params.sq_off.array);
+   m_cqHead = (unsigned*)(cq + params.cq_off.head);
+   m_cqTail = (unsigned*)(cq + params.cq_off.tail);
+   m_cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+   m_cqes = cq + params.cq_off.cqes;
+
+   m_bZeroCopy = false;
+   if(zeroCopy)
+   {
+      // Zero-copy needs IORING_OP_SEND_ZC and the buffers registered up front
+      char probeSpace[sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op)];
+      io_uring_probe* probe = (io_uring_probe*)probeSpace;
+      memset(probeSpace,0,sizeof(probeSpace));
+      bool supported = uringRegister(fd,IORING_REGISTER_PROBE,probe,256) == 0
+                    && probe->last_op >= IORING_OP_SEND_ZC
+                    && (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED);
+      if(supported)
+      {
+         iovec iov[URING_BUFFER_COUNT];
+         for(int i = 0; i < URING_BUFFER_COUNT; i++)
+         {
+            iov[i].iov_base = m_buffers + (size_t)i * URING_BUFFER_SIZE;
+            iov[i].iov_len = URING_BUFFER_SIZE;
+         }
+         m_bZeroCopy = uringRegister(fd,IORING_REGISTER_BUFFERS,iov,URING_BUFFER_COUNT) == 0;
+      }
+   }
+   return true;
+#else
+   (void)zeroCopy;
+   return false;
+#endif
+}
+
+/**
+* Waits for the kernel to release every buffer, then tears the ring down.
+* Data still queued is discarded; call Flush() first.
+*/
+void CUringWriter::Close()
+{
+#ifdef SCARA_HAVE_IO_URING
+   if(!IsOpen()) return;
+   try
+   {
+      while(m_nChain > 0) Reap(true);
+      for(int i = 0; i < URING_BUFFER_COUNT; i++)
+         while(m_slots[i].pending > 0) Reap(true);
+   }
+   catch(CSocketException&)
+   {
+   }
+   munmap(m_sqes,m_nSqesSize);
+   if(m_nCqRingSize != 0) munmap(m_cqRing,m_nCqRingSize);
+   munmap(m_sqRing,m_nSqRingSize);
+   close(m_ringFd);
+   free(m_buffers);
+   m_ringFd = -1;
+   m_sqRing = m_cqRing = m_sqes = m_cqes = NULL;
+   m_buffers = NULL;
+   m_bZeroCopy = false;
+#endif
+   m_nFill = -1;
+   m_nQueued = 0;
+   m_nChainSize = 0;
+   m_nChain = 0;
+   memset(m_slots,0,sizeof(m_slots));
+}
+
+/**
+* Copies len bytes into the send buffers. Every buffer that fills up is
+* queued and sent as soon as the previous chain has completed. Without
+* io_uring the bytes are written immediately. Returns len.
+* @param data Pre-encoded commands
+* @param len Number of bytes
+*/
+int CUringWriter::Write(const char* data,int len) throw (CSocketException)
+{
+   if(!IsOpen()) return m_robot->SendAll(data,len);
+
+   int done = 0;
+   while(done < len)
+   {
+      if(m_nFill < 0) m_nFill = TakeFreeSlot();
+      CSlot& slot = m_slots[m_nFill];
+      int n = len - done;
+      if(n > URING_BUFFER_SIZE - slot.length) n = URING_BUFFER_SIZE - slot.length;
+      memcpy(m_buffers + (size_t)m_nFill * URING_BUFFER_SIZE + slot.length,data + done,n);
+      slot.length += n;
+      done += n;
+      if(slot.length == URING_BUFFER_SIZE)
+      {
+         m_queued[m_nQueued++] = m_nFill;
+         m_nFill = -1;
+         Pump();
+      }
+   }
+   return len;
+}
+
+/**
+* Sends the partly filled buffer and everything queued, and waits until
+* the kernel has written all of it.
+*/
+void CUringWriter::Flush() throw (CSocketException)
+{
+   if(!IsOpen()) return;
+   if(m_nFill >= 0 && m_slots[m_nFill].length > 0)
+   {
+      m_queued[m_nQueued++] = m_nFill;
+      m_nFill = -1;
+   }
+   while(m_nQueued > 0 || m_nChain > 0)
+   {
+      if(m_nChain == 0) SubmitChain();
+      else Reap(true);
+   }
+}
+
+void CUringWriter::Pump() throw (CSocketException)
+{
+   Reap(false);
+   if(m_nChain == 0 && m_nQueued > 0) SubmitChain();
+}
+
+/**
+* Returns a buffer that is neither filling, queued, in flight nor still
+* referenced by a zero-copy send, waiting for completions if there is none.
+*/
+int CUringWriter::TakeFreeSlot() throw (CSocketException)
+{
+   while(true)
+   {
+      for(int i = 0; i < URING_BUFFER_COUNT; i++)
+         if(i != m_nFill && m_slots[i].length == 0 && m_slots[i].pending == 0) return i;
+      if(m_nChain == 0 && m_nQueued > 0) SubmitChain();
+      else Reap(true);
+   }
+}
+
+/**
+* Turns the queued buffers into one chain of sends linked with
+* IOSQE_IO_LINK, so the kernel starts each only after the previous one has
+* finished, and submits the chain with a single io_uring_enter().
+*/
+void CUringWriter::SubmitChain() throw (CSocketException)
+{
+#ifdef SCARA_HAVE_IO_URING
+   io_uring_sqe* sqes = (io_uring_sqe*)m_sqes;
+   unsigned tail = *m_sqTail;
+   for(int i = 0; i < m_nQueued; i++)
+   {
+      int index = m_queued[i];
+      unsigned entry = tail & *m_sqMask;
+      io_uring_sqe* sqe = &sqes[entry];
+      memset(sqe,0,sizeof(*sqe));
+      sqe->opcode = m_bZeroCopy ? IORING_OP_SEND_ZC : IORING_OP_SEND;
+      sqe->fd = m_robot->GetSocket();
+      sqe->addr = (unsigned long long)(m_buffers + (size_t)index * URING_BUFFER_SIZE);
+      sqe->len = m_slots[index].length;
+      sqe->msg_flags = SOCKET_SEND_FLAGS | MSG_WAITALL;
+      sqe->user_data = (unsigned long long)index;
+      if(m_bZeroCopy)
+      {
+         sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+         sqe->buf_index = (unsigned short)index;
+      }
+      if(i < m_nQueued - 1) sqe->flags = IOSQE_IO_LINK;
+      m_sqArray[entry] = entry;
+      m_slots[index].sent = 0;
+      m_slots[index].pending = m_bZeroCopy ? 2 : 1;
+      m_chain[i] = index;
+      tail++;
+   }
+   __atomic_store_n(m_sqTail,tail,__ATOMIC_RELEASE);
+   m_nChainSize = m_nChain = m_nQueued;
+   int submitted = m_nQueued;
+   m_nQueued = 0;
+
+   m_nSubmits++;
+   if(uringEnter(m_ringFd,submitted,0,0) < 0)
+   {
+      int nret = errno;
+      m_nChainSize = m_nChain = 0;
+      throw CSocketException(nret, "io_uring submit failed: Flush()");
+   }
+#endif
+}
+
+/**
+* Processes every completion available, waiting for at least one first if
+* wait is true. When the last send of the chain completes, anything a
+* short send left unwritten is sent before the next chain may start.
+*/
+void CUringWriter::Reap(bool wait) throw (CSocketException)
+{
+#ifdef SCARA_HAVE_IO_URING
+   io_uring_cqe* cqes = (io_uring_cqe*)m_cqes;
+   unsigned head = *m_cqHead;
+   if(wait && head == __atomic_load_n(m_cqTail,__ATOMIC_ACQUIRE))
+   {
+      m_nSubmits++;
+      if(uringEnter(m_ringFd,0,1,IORING_ENTER_GETEVENTS) < 0)
+         throw CSocketException(errno, "io_uring wait failed: Flush()");
+   }
+
+   int error = 0;
+   unsigned tail = __atomic_load_n(m_cqTail,__ATOMIC_ACQUIRE);
+   for(; head != tail; head++)
+   {
+      io_uring_cqe* cqe = &cqes[head & *m_cqMask];
+      CSlot& slot = m_slots[cqe->user_data];
+      if(cqe->flags & IORING_CQE_F_NOTIF)
+      {
+         slot.pending--; // zero-copy buffer released
+         continue;
+      }
+      if(cqe->res >= 0) slot.sent += cqe->res;
+      else if(cqe->res != -ECANCELED && error == 0) error = -cqe->res;
+      slot.pending -= (m_bZeroCopy && !(cqe->flags & IORING_CQE_F_MORE)) ? 2 : 1;
+      m_nChain--;
+   }
+   __atomic_store_n(m_cqHead,head,__ATOMIC_RELEASE);
+
+   if(error != 0)
+      throw CSocketException(error, "Network failure: Write()");
+   if(m_nChain == 0 && m_nChainSize > 0) FinishChain();
+#else
+   (void)wait;
+#endif
+}
+
+/**
+* A short send breaks the link chain and cancels the sends after it. Their
+* bytes are written here, in order, with the blocking send loop; then the
+* chain's buffers are released for filling.
+*/
+void CUringWriter::FinishChain() throw (CSocketException)
+{
+   int count = m_nChainSize;
+   m_nChainSize = 0;
+   for(int i = 0; i < count; i++)
+   {
+      CSlot& slot = m_slots[m_chain[i]];
+      if(slot.sent < slot.length)
+         m_robot->SendAll(m_buffers + (size_t)m_chain[i] * URING_BUFFER_SIZE + slot.sent,slot.length - slot.sent);
+      slot.length = 0;
+      slot.sent = 0;
+   }
+}
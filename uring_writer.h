@@ -0,0 +1,77 @@
+#ifndef _URING_WRITER_H_
+#define _URING_WRITER_H_
+
+#include "robot.h"
+
+#define URING_QUEUE_DEPTH   16    /// submission queue entries
+#define URING_BUFFER_COUNT  8     /// send buffers, each one SQE when submitted
+#define URING_BUFFER_SIZE   65536 /// bytes per send buffer
+
+namespace openutils
+{
+   /**
+   * High-rate writer for a connected CRobot using Linux io_uring. Write()
+   * copies pre-encoded commands into one of URING_BUFFER_COUNT send
+   * buffers; full buffers go to the kernel as one chain of linked send
+   * SQEs, so they are written in order with one io_uring_enter() for the
+   * whole chain, and completions are reaped in batches. Only one chain is
+   * in flight at a time, which keeps the byte stream ordered while the
+   * caller fills the remaining buffers.
+   *
+   * With Open(true), where IORING_OP_SEND_ZC is supported, the buffers
+   * are registered with the kernel and sent zero-copy straight from the
+   * registered memory. Plain IORING_OP_SEND cannot use registered
+   * buffers, so the default Open() leaves them unregistered. Open()
+   * returns false when io_uring is not available (other platforms, old
+   * kernels, seccomp), and Write() then falls back to the robot's blocking
+   * send loop. No pacing is applied: this is for PACING_NONE streaming.
+   */
+   class CUringWriter
+   {
+   private:
+      struct CSlot
+      {
+         int length; /// bytes filled
+         int sent; /// bytes the kernel reported written
+         int pending; /// completions still expected (send, zero-copy notification)
+      };
+
+      CRobot* m_robot; /// connection written to
+      int m_ringFd; /// io_uring instance, -1 when closed
+      void* m_sqRing; /// mapped submission ring
+      void* m_cqRing; /// mapped completion ring (same as m_sqRing with single mmap)
+      void* m_sqes; /// mapped submission queue entries
+      size_t m_nSqRingSize,m_nCqRingSize,m_nSqesSize; /// mapping sizes
+      unsigned *m_sqHead,*m_sqTail,*m_sqMask,*m_sqArray; /// submission ring fields
+      unsigned *m_cqHead,*m_cqTail,*m_cqMask; /// completion ring fields
+      void* m_cqes; /// completion queue entries
+      char* m_buffers; /// URING_BUFFER_COUNT send buffers back to back, registered when zero-copy
+      CSlot m_slots[URING_BUFFER_COUNT]; /// state of each buffer
+      int m_nFill; /// buffer being filled, -1 if none
+      int m_queued[URING_BUFFER_COUNT]; /// full buffers waiting for the next chain
+      int m_nQueued; /// entries in m_queued
+      int m_chain[URING_BUFFER_COUNT]; /// buffers of the chain in flight, in order
+      int m_nChainSize; /// entries in m_chain
+      int m_nChain; /// sends of the current chain not yet completed
+      bool m_bZeroCopy; /// sends use IORING_OP_SEND_ZC with registered buffers
+      long m_nSubmits; /// io_uring_enter() calls made
+   public:
+      CUringWriter(CRobot* robot); /// Writes to robot's socket
+      ~CUringWriter(); /// Flushes and releases the ring
+      bool Open(bool zeroCopy = false); /// Sets up the ring, returns false if io_uring is unavailable
+      void Close(); /// Releases the ring; later writes use the fallback
+      bool IsOpen() { return m_ringFd >= 0; } /// True while io_uring is in use
+      bool IsZeroCopy() { return m_bZeroCopy; } /// True if sends are zero-copy from registered buffers
+      int Write(const char* data,int len) throw (CSocketException); /// Queues bytes, returns len
+      void Flush() throw (CSocketException); /// Submits everything queued and waits until it is written
+      long GetSubmitCount() { return m_nSubmits; } /// Returns the io_uring_enter() calls made
+   private:
+      void Pump() throw (CSocketException); /// Reaps without waiting and starts the next chain
+      int TakeFreeSlot() throw (CSocketException); /// Returns a free buffer, reaping completions if needed
+      void SubmitChain() throw (CSocketException); /// Sends the queued buffers as one linked chain
+      void Reap(bool wait) throw (CSocketException); /// Processes completions, optionally waiting for one
+      void FinishChain() throw (CSocketException); /// Rewrites whatever a short send left behind
+   };
+}
+
+#endif